@@ -24,18 +24,23 @@
 /*
  * Overview of A.I. Algorithm and Data
  *
- * The Board class contains an array of 6x7 (i.e. 42) integers, index 0-41.
- * The upper-left corner is 0, and the lower-right corner is 41. If the rows
- * are numbered 0-5, and the columns are numbered 0-6, then the location of
- * one square in the grid is 7 * row + col. The squares contain a 0 for a
- * blank, a -1 for Player One (human), and a 1 for Player Two (computer).
+ * The board has 6x7 (i.e. 42) squares, index 0-41.  The upper-left corner
+ * is 0, and the lower-right corner is 41. If the rows are numbered 0-5, and
+ * the columns are numbered 0-6, then the location of one square in the grid
+ * is 7 * row + col.  getBoardState() gives a 0 for a blank, a -1 for Player
+ * One (human), and a 1 for Player Two (computer) in each square.
+ *
+ * The Board class keeps the pieces themselves in a Position, two 64-bit
+ * bitboards laid out column by column (see position.h), which finds the
+ * row a piece lands on, and the square a piece is taken back from, without
+ * looking at the squares of the column one by one.
  * 
- * The Board class also contains an array of 69 integers.  The first 24 are
- * the horizontal rows of four squares (quads), four in each of the six
- * different columns.  The row from square 0 to 3 is quad 0, the row from
- * square 3 to 6 is quad 3, the row from 35 to 38 is quad 20, the row from
- * to 38 to 41 is quad 23. The next 21 are the vertical columns of four
- * squares (also called quads). The column from 0 to 21 is quad 24, the
+ * The Board class also contains an array of 69 small integers, a byte each.
+ * The first 24 are the horizontal rows of four squares (quads), four in each
+ * of the six different columns.  The row from square 0 to 3 is quad 0, the
+ * row from square 3 to 6 is quad 3, the row from 35 to 38 is quad 20, the
+ * row from to 38 to 41 is quad 23. The next 21 are the vertical columns of
+ * four squares (also called quads). The column from 0 to 21 is quad 24, the
  * column from 14 to 35 is quad 26, the column from 6 to 27 is quad 42, the
  * column from 20 to 41 is quad 44. The next 12 are the upperleft-lowerright
  * diagonals.  Starting from the upperleft, the diagonal starting at 0 is
@@ -46,9 +51,9 @@
  * the diagonal starting at 17 is quad 65, the diagonal starting at 20 is
  * quad 68.
  *
- * Change: All quad numbers above are increased by 1, and the 0 is used as a
- * stop. The quads for each square (up to 14 with stop) are held in a const
- * integer array.
+ * Change: All quad numbers above are increased by 1. The quads for each
+ * square (up to 13) are held in a const byte array, in rows padded to 13,
+ * with the number of quads of each square in another.
  *
  * Anyhow, these 69 'quads' represent all of the ways to win (or lose), so
  * owning a piece of these quads is a step towards winning.  However, if the
@@ -90,19 +95,205 @@
  * further search on the other move is unnecessary, because it will never
  * happen. The converse is also true, with the roles of mini and max
  * transposed.
+ *
+ * Rather than a max function and a mirror-image mini function, the search
+ * is written once, as negamax: calcEval() returns the value of a position
+ * to whoever is to move, which is m_sumStatEval for max and its negation
+ * for mini.  A daughter's value to the parent is then the negation of its
+ * value to the daughter, and the parent's window (alpha, beta) is passed
+ * down as (-beta, -alpha), raised to the best value found so far, so that
+ * every node prunes against the best either side is already sure of.
+ *
+ * The daughters are searched best first, so once the eldest has been
+ * searched the rest are expected to be no better.  Each of them is first
+ * searched with a null window (alpha, alpha + 1), which only proves whether
+ * it is better than alpha and so prunes far more, and is searched again with
+ * the full window only if it turns out to be better (principal variation
+ * search).  At the higher difficulties, that null window search is first
+ * made two plies shallower, and to the full depth only if the shallow one
+ * shows the daughter might be better (late move reduction).
+ *
+ * The root itself is searched in an aspiration window around the value it
+ * is expected to have, and again with a full window if the value falls
+ * outside it (see searchDeepening()).  Alternatively (setDriver()), the
+ * root can be searched by MTD(f), with nothing but null windows.
+ *
+ * The root of the tree is searched in parallel on the threads of the search
+ * pool (searchpool.cpp), which live as long as the process does.  The first
+ * root move is searched alone, as it is most likely best; then each root
+ * task takes a copy of the board and repeatedly pulls the next untried root
+ * move off a shared list, so the statically best moves are started first.
+ * The best value found so far is shared (under a mutex) and is read as
+ * alpha each time a task starts on a new root move, so the later root moves
+ * are searched with windows as tight as in the serial case.
+ *
+ * Below the root, the search uses the "young brothers wait" rule: a node
+ * deep enough in the tree becomes a split point once its first (statically
+ * best) daughter has been searched without a prune, and only if the pool
+ * has a thread looking for work.  The remaining daughters are then shared
+ * out like the root moves: the thread that owns the node pushes a task per
+ * daughter onto its deque in the pool, for idle threads to steal, and works
+ * through the daughters itself.  A stolen task copies the board and then
+ * pulls daughters off the same list, so each daughter's subtree is searched
+ * by whichever thread gets to it first.  When any of them finds a prune,
+ * it sets the split point's cutoff flag.  Every thread
+ * below a split point checks the flags of all of the split points above it
+ * after each daughter, and abandons its (now pointless) work if one is set.
+ *
+ * The same position is reached by many orders of the same moves, so the
+ * result of searching each interior node is kept in a transposition table
+ * (transtable.cpp) shared by all of the threads.  Positions are identified
+ * by a Zobrist key: a random 64-bit number for each square and player, all
+ * XORed together for the pieces on the board, and XORed with one more if it
+ * is the computer's turn.  move() and remove() keep the key up to date with
+ * two XORs.  A stored value ends the search of a node if it was searched at
+ * least as deep and the value (or bound) decides the node; otherwise the
+ * stored best move is at least searched first.
+ *
+ * Before anything else, each interior node asks the bitboards whether the
+ * player to move can win at once, and if so returns the value of the win
+ * without searching.  Otherwise, moves that let the opponent win with the
+ * next move are dropped before the branching factor is cut: if the opponent
+ * has a four to complete, only the move that blocks it is left, and no move
+ * is made just below a square where the opponent would complete a four.
+ * So a block is never cut from the search for looking statically weak.
+ *
+ * Each daughter is searched on a copy of the board with its move made,
+ * rather than by making the move on the board and taking it back with
+ * remove() after: the board is small enough (see board.h) that the copy is
+ * quicker than walking the quads of the square again.  MAGIC_COPY_MAKE
+ * chooses between the two when building.
+ *
+ * Once the pool and the table exist, a search allocates nothing from the
+ * heap.  Every node's list of moves and their values is a fixed array on the
+ * stack of the thread searching it, as are the copies of the board and the
+ * split points, and the recursion is never deeper than the 42 squares.
  */
 
 #include <stdlib.h>
 #include <time.h>
+#include <pthread.h>
 #include "board.h"
+#include "searchpool.h"
+#include "transtable.h"
+#include "solver.h"
+#include "book.h"
+
+// the state shared by the tasks searching the root moves
+struct RootSearch
+{
+	pthread_mutex_t mutex;
+	const Board* pBoard;   // the position being searched, copied by tasks
+	const int* rgMoves;    // root moves, best static value first
+	int movesLim;
+	int iMoveNext;         // index of the next root move nobody has taken
+	int depth;             // depth passed on to the root moves
+	int alpha;             // the best value so far, to the side to move
+	int beta;              // the top of the window the root is searched in
+	int best;
+	int iBest;             // index in rgMoves of best, movesLim if none
+	int bestmove;
+	int secondbestmove;
+	unsigned long long cNodes;  // interior nodes searched by the tasks
+};
+
+// the state shared by the threads searching the daughters of a split point
+struct SplitPoint
+{
+	pthread_mutex_t mutex;
+	Board board;           // the node, copied by the helping tasks
+	SplitPoint* pParent;   // the split point the owner was helping, or NULL
+	const int* rgMoves;    // daughters not yet searched, best first
+	int movesLim;
+	int iMoveNext;         // index of the next daughter nobody has taken, atomic
+	int depth;             // depth passed on to the daughters
+	int alpha;             // raised as daughters are searched
+	int beta;
+	int best;
+	int colBest;           // the daughter with value best
+	int fCutoff;           // set when a daughter causes a prune, atomic
+	unsigned long long cNodes;  // interior nodes searched by helping tasks
+};
+
+// the clock that a search with a time budget runs against
+struct SearchLimit
+{
+	long long nsDeadline;  // CLOCK_MONOTONIC time to stop at, 0 for never
+	int fStop;             // set once the deadline has passed, atomic
+};
+
+// what a difficulty sets; see setDifficulty() and mconst_rgSettings
+struct BoardSettings
+{
+	unsigned char difficulty;        // from 0 to 10, increasing in difficulty
+	unsigned char depthMax;          // ply, no. of moves to search ahead
+	unsigned char branchFactor;      // most daughters searched at a node
+	unsigned char branchFactorLate;  // the same once there are movesLate pieces
+	unsigned char movesLate;         // pieces on the board when the late game starts
+	unsigned char reduceMovesMin;    // daughters searched before any are reduced
+	double chancePickBest;           // the chance the computer will pick the best move
+	double chancePickSecondBest;     // the chance the computer will pick second best move
+};
+
+// returns the CLOCK_MONOTONIC time in nanoseconds
+static long long nsNow( void )
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
 
 // this is an error code returned in place of a column number
 const int Board::mconst_colNil = -1;
 
-// set the default difficulty to level 4, and the max branch factor to 4 moves
+// set the default difficulty to level 4
 const int Board::mconst_defaultDifficulty = 4;
 
+// the difficulty at which the computer plays perfectly, using the solver
+const int Board::mconst_difficultyPerfect = 10;
+
+// the ways the root can be searched, see setDriver()
+const int Board::mconst_driverAlphaBeta = 0;
+const int Board::mconst_driverMtdf      = 1;
+
+// Interior nodes search at most this many daughters, the statically best.
+// At difficulties 8 and up they search one fewer until the late game,
+// which has fewer playable columns and more forced lines, and the plies
+// this saves are spent searching deeper, for the same time per move.
 const int Board::mconst_branchFactorMax   = 4;
+const int Board::mconst_branchFactorEarly = 3;
+const int Board::mconst_movesLate         = 20;
+
+// Late move reduction, see calcEvalBrother(): at difficulties 8 and up,
+// the daughters after the first mconst_reduceMovesMin, with at least
+// mconst_reduceDepthMin plies left below them, are first searched
+// mconst_reduction plies shallower. Two plies rather than one, as the
+// value at one depth swings from the value one ply shallower.
+const int Board::mconst_reduceMovesMin    = 1;
+const int Board::mconst_reduceDepthMin    = 3;
+const int Board::mconst_reduction         = 2;
+
+// Nodes with fewer plies than this left below them are never split, as
+// copying the board and waiting at the split point would cost more than the
+// search it shares out.  Nor are nodes in a reduced search, which mostly
+// fails low at once (see calcEvalBrother()).
+const int Board::mconst_splitDepthMin     = 6;
+
+// with a time budget, each thread looks at the clock once per this many
+// interior nodes (a power of two)
+const int Board::mconst_nodesPerClockCheck = 1024;
+
+// Playing perfectly, the computer only uses the solver from this many moves
+// into the game, as solving the opening takes minutes rather than seconds,
+// and even with ten pieces some positions take several.  Before that, it
+// plays the book's move (see book.cpp) or, out of the book, as at
+// difficulty 9.
+const int Board::mconst_solveMovesMin = 12;
+
+// The root is searched this far either side of the value it is expected to
+// have: half a quad of three, which is usually near enough.
+const int Board::mconst_aspirationWindow = 8;
 
 // actually 69 quads, but 0 isn't used (so 1-69)
 const int Board::mconst_quadLim        = MAGIC_LIMIT_QUAD;
@@ -128,53 +319,78 @@ const int Board::mconst_dEvalP1 = 1,
 const int Board::mconst_evalPositiveWinMin = 1000;
 const int Board::mconst_evalNegativeWinMin = -1000;
 
-// posquad holds the quad numbers for each of the 42 squares, ended by a 0
+// posquad holds the quad numbers for each of the 42 squares, in rows of a
+// fixed MAGIC_LIMIT_QUAD_PER_POS bytes padded with 0, and quadsperpos how
+// many of each row are quads, so that the quads of a square are a count and
+// a run of bytes rather than a list to look for the end of
 // the data below was generated by a program commented out at the end of
 // the file
-const int
+const unsigned char
 Board::mconst_mpPosQuads[ MAGIC_LIMIT_POS ][ MAGIC_LIMIT_QUAD_PER_POS ] = {
-	{1, 25, 46, 0},
-	{1, 2, 28, 47, 0},
-	{1, 2, 3, 31, 48, 0},
-	{1, 2, 3, 4, 34, 49, 58, 0},
-	{2, 3, 4, 37, 59, 0},
-	{3, 4, 40, 60, 0},
-	{4, 43, 61, 0},
-	{5, 25, 26, 50, 0},
-	{5, 6, 28, 29, 51, 46, 0},
-	{5, 6, 7, 31, 32, 52, 47, 58, 0},
-	{5, 6, 7, 8, 34, 35, 53, 48, 62, 59, 0},
-	{6, 7, 8, 37, 38, 49, 63, 60, 0},
-	{7, 8, 40, 41, 64, 61, 0},
-	{8, 43, 44, 65, 0},
-	{9, 25, 26, 27, 54, 0},
-	{9, 10, 28, 29, 30, 55, 50, 58, 0},
-	{9, 10, 11, 31, 32, 33, 56, 51, 46, 62, 59, 0},
-	{9, 10, 11, 12, 34, 35, 36, 57, 52, 47, 66, 63, 60, 0},
-	{10, 11, 12, 37, 38, 39, 53, 48, 67, 64, 61, 0},
-	{11, 12, 40, 41, 42, 49, 68, 65, 0},
-	{12, 43, 44, 45, 69, 0},
-	{13, 25, 26, 27, 58, 0},
-	{13, 14, 28, 29, 30, 54, 62, 59, 0},
-	{13, 14, 15, 31, 32, 33, 55, 50, 66, 63, 60, 0},
-	{13, 14, 15, 16, 34, 35, 36, 56, 51, 46, 67, 64, 61, 0},
-	{14, 15, 16, 37, 38, 39, 57, 52, 47, 68, 65, 0},
-	{15, 16, 40, 41, 42, 53, 48, 69, 0},
-	{16, 43, 44, 45, 49, 0},
-	{17, 26, 27, 62, 0},
-	{17, 18, 29, 30, 66, 63, 0},
-	{17, 18, 19, 32, 33, 54, 67, 64, 0},
-	{17, 18, 19, 20, 35, 36, 55, 50, 68, 65, 0},
-	{18, 19, 20, 38, 39, 56, 51, 69, 0},
-	{19, 20, 41, 42, 57, 52, 0},
-	{20, 44, 45, 53, 0},
-	{21, 27, 66, 0},
-	{21, 22, 30, 67, 0},
-	{21, 22, 23, 33, 68, 0},
-	{21, 22, 23, 24, 36, 54, 69, 0},
-	{22, 23, 24, 39, 55, 0},
-	{23, 24, 42, 56, 0},
-	{24, 45, 57, 0}
+	{1, 25, 46},
+	{1, 2, 28, 47},
+	{1, 2, 3, 31, 48},
+	{1, 2, 3, 4, 34, 49, 58},
+	{2, 3, 4, 37, 59},
+	{3, 4, 40, 60},
+	{4, 43, 61},
+	{5, 25, 26, 50},
+	{5, 6, 28, 29, 51, 46},
+	{5, 6, 7, 31, 32, 52, 47, 58},
+	{5, 6, 7, 8, 34, 35, 53, 48, 62, 59},
+	{6, 7, 8, 37, 38, 49, 63, 60},
+	{7, 8, 40, 41, 64, 61},
+	{8, 43, 44, 65},
+	{9, 25, 26, 27, 54},
+	{9, 10, 28, 29, 30, 55, 50, 58},
+	{9, 10, 11, 31, 32, 33, 56, 51, 46, 62, 59},
+	{9, 10, 11, 12, 34, 35, 36, 57, 52, 47, 66, 63, 60},
+	{10, 11, 12, 37, 38, 39, 53, 48, 67, 64, 61},
+	{11, 12, 40, 41, 42, 49, 68, 65},
+	{12, 43, 44, 45, 69},
+	{13, 25, 26, 27, 58},
+	{13, 14, 28, 29, 30, 54, 62, 59},
+	{13, 14, 15, 31, 32, 33, 55, 50, 66, 63, 60},
+	{13, 14, 15, 16, 34, 35, 36, 56, 51, 46, 67, 64, 61},
+	{14, 15, 16, 37, 38, 39, 57, 52, 47, 68, 65},
+	{15, 16, 40, 41, 42, 53, 48, 69},
+	{16, 43, 44, 45, 49},
+	{17, 26, 27, 62},
+	{17, 18, 29, 30, 66, 63},
+	{17, 18, 19, 32, 33, 54, 67, 64},
+	{17, 18, 19, 20, 35, 36, 55, 50, 68, 65},
+	{18, 19, 20, 38, 39, 56, 51, 69},
+	{19, 20, 41, 42, 57, 52},
+	{20, 44, 45, 53},
+	{21, 27, 66},
+	{21, 22, 30, 67},
+	{21, 22, 23, 33, 68},
+	{21, 22, 23, 24, 36, 54, 69},
+	{22, 23, 24, 39, 55},
+	{23, 24, 42, 56},
+	{24, 45, 57}
+};
+
+const unsigned char Board::mconst_rgQuadsPerPos[ MAGIC_LIMIT_POS ] = {
+	 3,  4,  5,  7,  5,  4,  3,
+	 4,  6,  8, 10,  8,  6,  4,
+	 5,  8, 11, 13, 11,  8,  5,
+	 5,  8, 11, 13, 11,  8,  5,
+	 4,  6,  8, 10,  8,  6,  4,
+	 3,  4,  5,  7,  5,  4,  3
+};
+
+// the square (as above, 0 the upper-left corner) of each bit of a Position
+// (see position.h), 7 bits to a column from the bottom up; the 7th bit of
+// each column is above the board, so has no square
+const int Board::mconst_mpBitPos[ MAGIC_LIMIT_BITS ] = {
+	35, 28, 21, 14,  7,  0, -1,
+	36, 29, 22, 15,  8,  1, -1,
+	37, 30, 23, 16,  9,  2, -1,
+	38, 31, 24, 17, 10,  3, -1,
+	39, 32, 25, 18, 11,  4, -1,
+	40, 33, 26, 19, 12,  5, -1,
+	41, 34, 27, 20, 13,  6, -1
 };
 
 // the quadcode system tells how many max's and min's are in it with the
@@ -188,14 +404,14 @@ Board::mconst_mpPosQuads[ MAGIC_LIMIT_POS ][ MAGIC_LIMIT_QUAD_PER_POS ] = {
 
 // this will return the next (even) quadcode when a square is added
 // -1 is error, already 4 squares for quad
-const int Board::mconst_rgUpQuadcode[] = {
+const signed char Board::mconst_rgUpQuadcode[] = {
 	 2, 10,  4, 12,  6, 14,  8, 16, -1, -1,
 	12, 18, 14, 20, 16, 22, -1, -1, 20, 24,
 	22, 26, -1, -1, 26, 28, -1, -1, -1, -1
 };
 
 // this will return the previous (even) quadcode when a square is removed
-const int Board::mconst_rgDownQuadcode[] = {
+const signed char Board::mconst_rgDownQuadcode[] = {
 	-1, -1,  0, -1,  2, -1,  4, -1,  6, -1,
 	-1,  0, 10,  2, 12,  4, 14,  6, -1, 10,
 	18, 12, 20, 14, -1, 18, 24, 20, -1, 24
@@ -235,36 +451,262 @@ const int Board::mconst_rgUpEval[] = {
 	0
 };
 
+// random numbers for the Zobrist key, for each square when taken by the
+// human (first) and by the computer (second), and for the computer's turn.
+// These were generated by splitmix64 with a seed of 0.
+const unsigned long long Board::mconst_rgZobrist[][ 2 ] = {
+	{ 0xe220a8397b1dcdafULL, 0x6e789e6aa1b965f4ULL },
+	{ 0x06c45d188009454fULL, 0xf88bb8a8724c81ecULL },
+	{ 0x1b39896a51a8749bULL, 0x53cb9f0c747ea2eaULL },
+	{ 0x2c829abe1f4532e1ULL, 0xc584133ac916ab3cULL },
+	{ 0x3ee5789041c98ac3ULL, 0xf3b8488c368cb0a6ULL },
+	{ 0x657eecdd3cb13d09ULL, 0xc2d326e0055bdef6ULL },
+	{ 0x8621a03fe0bbdb7bULL, 0x8e1f7555983aa92fULL },
+	{ 0xb54e0f1600cc4d19ULL, 0x84bb3f97971d80abULL },
+	{ 0x7d29825c75521255ULL, 0xc3cf17102b7f7f86ULL },
+	{ 0x3466e9a083914f64ULL, 0xd81a8d2b5a4485acULL },
+	{ 0xdb01602b100b9ed7ULL, 0xa9038a921825f10dULL },
+	{ 0xedf5f1d90dca2f6aULL, 0x54496ad67bd2634cULL },
+	{ 0xdd7c01d4f5407269ULL, 0x935e82f1db4c4f7bULL },
+	{ 0x69b82ebc92233300ULL, 0x40d29eb57de1d510ULL },
+	{ 0xa2f09dabb45c6316ULL, 0xee521d7a0f4d3872ULL },
+	{ 0xf16952ee72f3454fULL, 0x377d35dea8e40225ULL },
+	{ 0x0c7de8064963bab0ULL, 0x05582d37111ac529ULL },
+	{ 0xd254741f599dc6f7ULL, 0x69630f7593d108c3ULL },
+	{ 0x417ef96181daa383ULL, 0x3c3c41a3b43343a1ULL },
+	{ 0x6e19905dcbe531dfULL, 0x4fa9fa7324851729ULL },
+	{ 0x84eb4454a792922aULL, 0x134f7096918175ceULL },
+	{ 0x07dc930b302278a8ULL, 0x12c015a97019e937ULL },
+	{ 0xcc06c31652ebf438ULL, 0xecee65630a691e37ULL },
+	{ 0x3e84ecb1763e79adULL, 0x690ed476743aae49ULL },
+	{ 0x774615d7b1a1f2e1ULL, 0x22b353f04f4f52daULL },
+	{ 0xe3ddd86ba71a5eb1ULL, 0xdf268adeb6513356ULL },
+	{ 0x2098eb73d4367d77ULL, 0x03d6845323ce3c71ULL },
+	{ 0xc952c5620043c714ULL, 0x9b196bca844f1705ULL },
+	{ 0x30260345dd9e0ec1ULL, 0xcf448a5882bb9698ULL },
+	{ 0xf4a578dccbc87656ULL, 0xbfdeaed9a17b3c8fULL },
+	{ 0xed79402d1d5c5d7bULL, 0x55f070ab1cbbf170ULL },
+	{ 0x3e00a34929a88f1dULL, 0xe255b237b8bb18fbULL },
+	{ 0x2a7b67af6c6ad50eULL, 0x466d5e7f3e46f143ULL },
+	{ 0x42375cb399a4fc72ULL, 0x8c8a1f148a8bb259ULL },
+	{ 0x32fcab5daed5bdfcULL, 0x9e60398c8d8553c0ULL },
+	{ 0xee89cceb8c4064c0ULL, 0xdb0215941d86a66fULL },
+	{ 0x5ccde78203c367a8ULL, 0xf1bcbc6a1ec11786ULL },
+	{ 0xef054fceee954551ULL, 0xdf82012d0555c6dfULL },
+	{ 0x292566ff72403c08ULL, 0xc4dd302a1bfa1137ULL },
+	{ 0xd85f219db5c554e1ULL, 0x6a27ff807441bcd2ULL },
+	{ 0x96a573e9b48216e8ULL, 0x46a9fdac40bf0048ULL },
+	{ 0x3dd12464a0ee15b4ULL, 0x451e521296a7eea1ULL }
+};
+
+const unsigned long long Board::mconst_zobristComputerTurn = 0x56e4398a98f8a0fdULL;
+
+// m_rgHistory holds the column of each move in mconst_bitsPerHistory bits,
+// mconst_movesPerHistory moves to a word, the first move in the lowest bits
+const int Board::mconst_movesPerHistory = 21;
+const int Board::mconst_bitsPerHistory  = 3;
+
+// m_heights holds the number of pieces in each column in
+// mconst_bitsPerHeight bits, column 0 in the lowest bits
+const int Board::mconst_bitsPerHeight = 3;
+
+// the bit of getPositionKey() set when it is the computer's turn, above the
+// 49 bits of the Position's key
+const unsigned long long Board::mconst_keyComputerTurn = 1ULL << 63;
+
+// The settings of each difficulty.  Up to 4, the search is shallow and the
+// computer plays its best or second best move only some of the time; from
+// 5, it plays one of the two; 9 and 10 play the best for sure, and from 8
+// the search is narrowed by mconst_branchFactorEarly until
+// mconst_movesLate pieces and by late move reductions (see
+// mconst_reduceMovesMin), which let it look further ahead.
+const BoardSettings Board::mconst_rgSettings[ MAGIC_LIMIT_DIFFICULTY ] = {
+	{ 0,  1, mconst_branchFactorMax, mconst_branchFactorMax, 0, MAGIC_LIMIT_COLS,
+	  0.1 * 1, 0.1 * 1 },
+	{ 1,  2, mconst_branchFactorMax, mconst_branchFactorMax, 0, MAGIC_LIMIT_COLS,
+	  0.1 * 2, 0.1 * 2 },
+	{ 2,  3, mconst_branchFactorMax, mconst_branchFactorMax, 0, MAGIC_LIMIT_COLS,
+	  0.1 * 3, 0.1 * 3 },
+	{ 3,  4, mconst_branchFactorMax, mconst_branchFactorMax, 0, MAGIC_LIMIT_COLS,
+	  0.1 * 4, 0.1 * 4 },
+	{ 4,  5, mconst_branchFactorMax, mconst_branchFactorMax, 0, MAGIC_LIMIT_COLS,
+	  0.1 * 5, 0.1 * 5 },
+	{ 5,  7, mconst_branchFactorMax, mconst_branchFactorMax, 0, MAGIC_LIMIT_COLS,
+	  0.1 * 6, 1.0 - 0.1 * 6 },
+	{ 6,  9, mconst_branchFactorMax, mconst_branchFactorMax, 0, MAGIC_LIMIT_COLS,
+	  0.1 * 7, 1.0 - 0.1 * 7 },
+	{ 7, 11, mconst_branchFactorMax, mconst_branchFactorMax, 0, MAGIC_LIMIT_COLS,
+	  0.1 * 8, 1.0 - 0.1 * 8 },
+	{ 8, 20, mconst_branchFactorEarly, mconst_branchFactorMax,
+	  mconst_movesLate, mconst_reduceMovesMin, 0.1 * 9, 1.0 - 0.1 * 9 },
+	{ 9, 23, mconst_branchFactorEarly, mconst_branchFactorMax,
+	  mconst_movesLate, mconst_reduceMovesMin, 0.1 * 10, 1.0 - 0.1 * 10 },
+	{ 10, 23, mconst_branchFactorEarly, mconst_branchFactorMax,
+	  mconst_movesLate, mconst_reduceMovesMin, 1.0, 0.0 },
+};
+
 Board::Board()
 {
-	int iPosition;
-	int iQuad;
+	clear();
+}
 
-	// set it all to zero
-	for (iPosition = 0; iPosition < mconst_posLim; iPosition++)
+// The board with the pieces and the player to move of key, as given by
+// getPositionKey(), and the default difficulty and settings.  The key has
+// no history, so the pieces are played in an order found by findHistory(),
+// which takeBackMove() then takes them back in.  If key is not a position
+// that a game could reach, the board is left empty.
+Board::Board( unsigned long long key )
+{
+	Position position;
+	int rgMoves[ MAGIC_LIMIT_POS ];
+	int rgStride[ MAGIC_LIMIT_COLS + 1 ];
+	char* rgDead;
+	int fComputerTurn = (key & mconst_keyComputerTurn) != 0;
+	int fFound = 0;
+	int iDead = 0;
+	int col, iMoves;
+
+	clear();
+
+	key &= ~mconst_keyComputerTurn;
+	if (!Position::isKey( key ))
 	{
-		m_rgPosition[ iPosition ] = 0;
+		return;
 	}
+	position = Position( key );
+
+	// the column heights as one number, for findHistory() to mark those it
+	// has tried
+	rgStride[ 0 ] = 1;
+	for (col = 0; col < MAGIC_LIMIT_COLS; col++)
+	{
+		rgStride[ col + 1 ] = rgStride[ col ] * (position.getHeight( col ) + 1);
+		iDead += rgStride[ col ] * position.getHeight( col );
+	}
+
+	rgDead = (char*)calloc( rgStride[ MAGIC_LIMIT_COLS ], sizeof( char ) );
+	if (rgDead)
+	{
+		fFound = findHistory( position, rgMoves, rgStride, rgDead, iDead );
+		free( rgDead );
+	}
+
+	if (fFound)
+	{
+		// whoever is to move moved first, if the number of pieces is even
+		if (fComputerTurn == !(position.getMoves() % 2))
+		{
+			setComputerFirst();
+		}
 
+		for (iMoves = 0; iMoves < position.getMoves(); iMoves++)
+		{
+			move( rgMoves[ iMoves ] );
+		}
+	}
+}
+
+void Board::clear( void )
+{
+	int iQuad;
+
+	// set it all to zero
 	for (iQuad = 0; iQuad < mconst_quadLim; iQuad++)
 		m_rgQuad[ iQuad ] = 0;
 
 	m_sumStatEval = 0;
+	m_key = 0;
+	m_keyMirror = 0;
+	m_rgHistory[ 0 ] = m_rgHistory[ 1 ] = 0;
+	m_heights = 0;
     m_cMoves = 0;
+	m_pSplit = NULL;
+	m_pLimit = NULL;
+	m_cNodes = 0;
+	m_msMoveTime = 0;
+	m_driver = mconst_driverAlphaBeta;
+	m_generation = 0;
+	m_fReduced = 0;
 
 	// it is human's turn by default, and a given difficulty by default
 	m_fIsComputerTurn = 0;
 	setDifficulty( mconst_defaultDifficulty );
 }
 
+// The position as a single number: the Position's key (see position.h),
+// which tells the pieces of the player to move, those of the other player
+// and the empty squares apart in 49 bits, with mconst_keyComputerTurn set
+// if the player to move is the computer.  It is kept up to date by move()
+// and remove() with the Position itself, so it costs nothing to read, and
+// Board( key ) makes a board with the same pieces and player to move.
+unsigned long long Board::getPositionKey( void )
+{
+	return m_position.getKey()
+	       | (m_fIsComputerTurn ? mconst_keyComputerTurn : 0);
+}
+
+// Sets rgMoves[ 0 .. n - 1 ], n the number of pieces of position, to the
+// columns of moves that, made in turn from the empty board, reach position
+// without either player winning before the last of them.  It works back
+// from the last move, which must be the top piece of its column and belong
+// to the player not to move, trying each such column in turn.
+// rgDead[ iDead ] is set once the column heights iDead (the sum of each
+// column's height times rgStride[ col ]) are found not to lead back to the
+// empty board, so that no heights are tried twice.  Returns 1 if the moves
+// were found, 0 if there are none.
+int Board::findHistory( Position position, int* rgMoves, const int* rgStride,
+                        char* rgDead, int iDead )
+{
+	unsigned long long last = position.getCurrent() ^ position.getMask();
+	Position before;
+	int cMoves = position.getMoves();
+	int col, height;
+
+	if (!cMoves)
+	{
+		return 1;
+	}
+
+	if (rgDead[ iDead ])
+	{
+		return 0;
+	}
+
+	for (col = 0; col < MAGIC_LIMIT_COLS; col++)
+	{
+		height = position.getHeight( col );
+		if (height && (last & (Position::bottomMask( col ) << (height - 1))))
+		{
+			before = position;
+			before.undo( col );
+			rgMoves[ cMoves - 1 ] = col;
+			if (!before.isWon()
+			    && findHistory( before, rgMoves, rgStride, rgDead,
+			                    iDead - rgStride[ col ] ))
+			{
+				return 1;
+			}
+		}
+	}
+
+	rgDead[ iDead ] = 1;
+	return 0;
+}
+
 // returns the number of moves that have been taken
 int Board::getNumMoves( void ) {
     return m_cMoves;
 }
 
+// returns the number of interior nodes searched for the computer's last move
+unsigned long long Board::getNodes( void )
+{
+	return m_cNodes;
+}
+
 // returns the most recent taken move
 int Board::getLastMove( void ) {
-    return m_rgHistory[m_cMoves - 1];
+    return getHistory( m_cMoves - 1 );
 }
 
 // returns 1 if computer won (max), 0 otherwise
@@ -288,69 +730,114 @@ int Board::isComputerTurn( void )
 // if not passed correctly, set to default difficulty
 void Board::setDifficulty( int difficulty )
 {
-	if (difficulty < 0 || difficulty > 9)
+	if (difficulty < 0 || difficulty > mconst_difficultyPerfect)
 	{
 		difficulty = mconst_defaultDifficulty;
 	}
 
-    // set the board difficulty
-   	m_difficulty = difficulty;
-
-	switch ( m_difficulty )
-	{
-	case 0:
-	case 1:
-	case 2:
-	case 3:
-	case 4:
-		m_depthMax = m_difficulty + 1;
-		m_chancePickBest = 0.1 * (m_difficulty + 1);
-		m_chancePickSecondBest = m_chancePickBest;
-		break;
-	case 5:
-	case 6:
-	case 7:
-		m_depthMax = 5 + 2 * ( m_difficulty - 4 );
-		m_chancePickBest = 0.1 * (m_difficulty + 1);
-		m_chancePickSecondBest = 1.0 - m_chancePickBest;
-		break;
-	case 8:
-	case 9:
-		m_depthMax = 11 + 3 * ( m_difficulty - 7 );
-		m_chancePickBest = 0.1 * (m_difficulty + 1);
-		m_chancePickSecondBest = 1.0 - m_chancePickBest;
-		break;
-	}
+	m_pSettings = &mconst_rgSettings[ difficulty ];
 
     // seed our random function
 	srand( (unsigned)time( NULL ) );
 }
 
+// With msMoveTime > 0, the computer searches deeper and deeper until it
+// has used up that many milliseconds, whatever the difficulty, and plays
+// the best move of the deepest search it finished.  With 0, it searches to
+// the fixed depth of the difficulty.  Once the solver is in use, playing
+// perfectly, it takes as long as the solver does.
+void Board::setMoveTime( int msMoveTime )
+{
+	m_msMoveTime = (msMoveTime > 0) ? msMoveTime : 0;
+}
+
+// With mconst_driverAlphaBeta, the default, the root is searched once in an
+// aspiration window around the value it is expected to have (see
+// searchAspiration()). With mconst_driverMtdf, it is searched repeatedly
+// with null windows that close in on the value (see searchMtdf()). Both
+// find the same value; which is quicker depends on the position.
+void Board::setDriver( int driver )
+{
+	m_driver = (driver == mconst_driverMtdf) ? mconst_driverMtdf
+	                                         : mconst_driverAlphaBeta;
+}
+
 void Board::setHumanFirst( void )
 {
     // set the boards first turn
+	if (m_fIsComputerTurn)
+	{
+		m_key ^= mconst_zobristComputerTurn;
+		m_keyMirror ^= mconst_zobristComputerTurn;
+	}
 	m_fIsComputerTurn = 0;
 }
 
 void Board::setComputerFirst( void )
 {
     // set the boards first turn
+	if (!m_fIsComputerTurn)
+	{
+		m_key ^= mconst_zobristComputerTurn;
+		m_keyMirror ^= mconst_zobristComputerTurn;
+	}
 	m_fIsComputerTurn = 1;
 }
 
 void Board::getBoardState( int rgPosition[ mconst_posLim ] )
 {
+	unsigned long long mask = m_position.getMask();
+	unsigned long long computer = m_fIsComputerTurn ? m_position.getCurrent()
+	                              : m_position.getCurrent() ^ mask;
+	unsigned long long bit;
+
 	for (int iPosition = 0; iPosition < mconst_posLim; iPosition++ )
 	{
-		rgPosition[ iPosition ] = m_rgPosition[ iPosition ];
+		bit = squareBit( iPosition );
+		rgPosition[ iPosition ] = (mask & bit) ? ((computer & bit) ? 1 : -1) : 0;
 	}
 }
 
+// the column of move iMove, counting from 0, of the game so far
+inline int Board::getHistory( int iMove )
+{
+	return (m_rgHistory[ iMove / mconst_movesPerHistory ]
+	        >> (iMove % mconst_movesPerHistory * mconst_bitsPerHistory))
+	       & ((1 << mconst_bitsPerHistory) - 1);
+}
+
+// records colMove as the column of move iMove
+inline void Board::setHistory( int iMove, int colMove )
+{
+	unsigned long long &history = m_rgHistory[ iMove / mconst_movesPerHistory ];
+	int shift = iMove % mconst_movesPerHistory * mconst_bitsPerHistory;
+
+	history &= ~((unsigned long long)((1 << mconst_bitsPerHistory) - 1) << shift);
+	history |= (unsigned long long)colMove << shift;
+}
+
+// The number of pieces in column col, kept in m_heights by move() and
+// remove(), as finding it on the bitboard takes a count of the column's bits
+// (which is a call into the compiler's library unless the build targets a
+// processor with an instruction for it).
+inline int Board::getHeight( int col )
+{
+	return (m_heights >> (col * mconst_bitsPerHeight))
+	       & ((1 << mconst_bitsPerHeight) - 1);
+}
+
+// the bit of the Position bitboards that holds a square (0-41)
+unsigned long long Board::squareBit( int square )
+{
+	return Position::bottomMask( square % 7 ) << (5 - square / 7);
+}
+
 // returns mconst_colNil on error, the column where move was made on success
 int Board::takeHumanTurn( int colMove )
 {
 	if ( isGameOver()
-	     || colMove < 0 || colMove > 6 || m_rgPosition[ colMove ] )
+	     || colMove < 0 || colMove > 6
+	     || getHeight( colMove ) == MAGIC_POSITION_HEIGHT )
 	{
 		colMove = mconst_colNil;
 	}
@@ -372,15 +859,10 @@ int Board::takeComputerTurn( void )
 	}
 	else
 	{
-		if ( m_fIsComputerTurn )
-	   	{
-			colMove = calcMaxMove();
-		}
-		else
-		{
-			colMove = calcMinMove();
-		}
-		
+		m_generation = (unsigned char)TransTable::newSearch();
+		m_cNodes = 0;
+
+		colMove = calcMove();
 		move( colMove );
 	}
 	
@@ -395,7 +877,7 @@ int Board::takeBackMove( void )
 	if ( m_cMoves )
 	{
 		remove();
-		colMove = m_rgHistory[ m_cMoves ];
+		colMove = getHistory( m_cMoves );
 	}
 	else
 	{
@@ -407,33 +889,30 @@ int Board::takeBackMove( void )
 
 void Board::move( int colMove )
 {
-	int quadTemp;
-	const int* pQuads;
-	int* colBase;
-	int rowBySevens;
+	const unsigned char* pQuads;
+	const unsigned char* pQuadsLim;
 	int square;
 
 	// add the latest move to history
-	m_rgHistory[ m_cMoves++ ] = colMove;
+	setHistory( m_cMoves++, colMove );
 
-	// find the lowest blank in column, thus setting the row
-	colBase = m_rgPosition + 35 + colMove; // i.e., bottom row, same column
-	rowBySevens = (*colBase ? (colBase[-7] ? (colBase[-14] ? (colBase[-21] ?
-	               (colBase[-28] ? 0 : 7) : 14) : 21) : 28) : 35);
-	square = rowBySevens + colMove;
+	// the lowest blank in column is the row above the pieces already there
+	square = 7 * (5 - getHeight( colMove )) + colMove;
+	m_heights += 1 << (colMove * mconst_bitsPerHeight);
 
-	// set this position's value to -1 for human, 1 for computer
-	// (whoever's turn it is)
-	m_rgPosition[ square ] = ( m_fIsComputerTurn ? 1 : -1 );
+	// drop the piece of whoever's turn it is
+	m_position.play( colMove );
+	m_key ^= mconst_rgZobrist[ square ][ m_fIsComputerTurn ]
+	         ^ mconst_zobristComputerTurn;
+	m_keyMirror ^= mconst_rgZobrist[ square + 6 - 2 * colMove ][ m_fIsComputerTurn ]
+	               ^ mconst_zobristComputerTurn;
 
 	// update the quads for this position
 	pQuads = mconst_mpPosQuads[ square ];
-	updateQuad(*pQuads++);
-	updateQuad(*pQuads++);
-	updateQuad(*pQuads++);
-	while ( quadTemp = *pQuads++ )
+	pQuadsLim = pQuads + mconst_rgQuadsPerPos[ square ];
+	for (; pQuads < pQuadsLim; pQuads++)
 	{
-		updateQuad( quadTemp );
+		updateQuad( *pQuads );
 	}
 
 	// give the other guy a turn
@@ -457,36 +936,115 @@ inline void Board::updateQuad( int iQuad )
 // that case, because it is a private member function optimized for speed.
 void Board::remove( void )
 {
-	int quadTemp;
-	const int* pQuads;
-	int* colBase;
-	int rowBySevens;
+	const unsigned char* pQuads;
+	const unsigned char* pQuadsLim;
 	int square;
 
 	// decrement movenum, retrieve last move
-	int colMove = m_rgHistory[ --m_cMoves ];
+	int colMove = getHistory( --m_cMoves );
 
-	// find the highest occupied square
-	colBase = m_rgPosition + colMove;
-	rowBySevens = (*colBase) ? 0 : (colBase[7] ? 7 : (colBase[14] ? 14 :
-	              (colBase[21] ? 21 : (colBase[28] ? 28 : 35))));
-	square = rowBySevens + colMove;
+	// the highest occupied square, which is the lowest blank once it is gone
+	m_heights -= 1 << (colMove * mconst_bitsPerHeight);
+	square = 7 * (5 - getHeight( colMove )) + colMove;
 
 	// if removing comp, now comp's turn; else human's if removing human
 	m_fIsComputerTurn = !m_fIsComputerTurn;
 
-	// set this position's value back to 0
-	m_rgPosition[ square ] = 0;
+	// take the piece back off the board
+	m_position.undo( colMove );
+	m_key ^= mconst_rgZobrist[ square ][ m_fIsComputerTurn ]
+	         ^ mconst_zobristComputerTurn;
+	m_keyMirror ^= mconst_rgZobrist[ square + 6 - 2 * colMove ][ m_fIsComputerTurn ]
+	               ^ mconst_zobristComputerTurn;
 
 	// reset the quads for this position
 	pQuads = mconst_mpPosQuads[ square ];
-	downdateQuad( *pQuads++ );
-	downdateQuad( *pQuads++ );
-	downdateQuad( *pQuads++ );
-	while (quadTemp = *pQuads++)
+	pQuadsLim = pQuads + mconst_rgQuadsPerPos[ square ];
+	for (; pQuads < pQuadsLim; pQuads++)
+	{
+		downdateQuad( *pQuads );
+	}
+}
+
+// Returns what m_sumStatEval would be after whoever's turn it is dropped a
+// piece in colMove, without making the move: the sum of what updateQuad()
+// would add for each quad of the square, read without writing anything.
+inline int Board::calcStatEvalAfter( int colMove )
+{
+	const unsigned char* pQuads;
+	const unsigned char* pQuadsLim;
+	int square = 7 * (5 - getHeight( colMove )) + colMove;
+	int sum = m_sumStatEval;
+
+	pQuads = mconst_mpPosQuads[ square ];
+	pQuadsLim = pQuads + mconst_rgQuadsPerPos[ square ];
+	for (; pQuads < pQuadsLim; pQuads++)
+	{
+		sum += mconst_rgUpEval[ m_rgQuad[ *pQuads ] + m_fIsComputerTurn ];
+	}
+
+	return sum;
+}
+
+// Sets rgEval[ col ], for each column col with room, to what m_sumStatEval
+// would be after whoever's turn it is dropped a piece in it, as
+// calcStatEvalAfter() does for one column, but for every column in one pass
+// over the bitboard's moves. Returns the moves, as Position::getPossible()
+// does.
+unsigned long long Board::calcStatEvalMoves( int rgEval[ MAGIC_LIMIT_COLS ] )
+{
+	unsigned long long possible = m_position.getPossible();
+	unsigned long long bits = possible;
+	const int* rgUpEval = mconst_rgUpEval + m_fIsComputerTurn;
+	const unsigned char* pQuads;
+	const unsigned char* pQuadsLim;
+	int square;
+	int bit;
+	int sum;
+
+	// one bit for the square each move would take
+	while (bits)
+	{
+		bit = __builtin_ctzll( bits );
+		bits &= bits - 1;
+
+		square = mconst_mpBitPos[ bit ];
+		pQuads = mconst_mpPosQuads[ square ];
+		pQuadsLim = pQuads + mconst_rgQuadsPerPos[ square ];
+		sum = m_sumStatEval;
+		for (; pQuads < pQuadsLim; pQuads++)
+		{
+			sum += rgUpEval[ m_rgQuad[ *pQuads ] ];
+		}
+
+		rgEval[ bit / (MAGIC_POSITION_HEIGHT + 1) ] = sum;
+	}
+
+	return possible;
+}
+
+// Returns the value, to whoever is to move, of the best of the positions
+// after each of their moves, by static evaluation: what calcEval() would
+// find making each move and taking it back at the end of the tree, but
+// read off the quads, with nothing written.
+int Board::calcStatEvalBest( void )
+{
+	int rgEval[ MAGIC_LIMIT_COLS ];
+	unsigned long long possible = calcStatEvalMoves( rgEval );
+	int best = mconst_worstEval;
+	int sign = m_fIsComputerTurn ? 1 : -1;
+	int col;
+
+	for (col = 0; col < MAGIC_LIMIT_COLS; col++)
 	{
-		downdateQuad( quadTemp );
+		if ((possible & Position::columnMask( col ))
+		    && sign * rgEval[ col ] > best)
+		{
+			best = sign * rgEval[ col ];
+		}
 	}
+
+	return best;
 }
 
 inline void Board::downdateQuad( int iQuad )
@@ -495,334 +1053,880 @@ inline void Board::downdateQuad( int iQuad )
 	m_sumStatEval -= mconst_rgUpEval[ m_rgQuad[ iQuad ] + m_fIsComputerTurn ];
 }
 
-int Board::calcMaxMove(void)
+int Board::calcMove(void)
 {
-	// the root node is max, and so has an alpha value.
-	int iMoves,iThreads;
-	int temp;
-	int alpha = mconst_worstEval;
-	int best = mconst_worstEval - 1;
 	int bestmove;
 	int secondbestmove;
 	double randomchance;
+	int rgScores[ MAGIC_LIMIT_COLS ];
+	BookEntry entry;
+	int iMoves;
+
+	// if the best move is to be played for sure, and the book knows it;
+	// playing perfectly, only a solved move will do
+	if (m_pSettings->chancePickBest >= 1.0
+	    && Book::probe( m_position, entry )
+	    && (entry.fExact
+	        || m_pSettings->difficulty != mconst_difficultyPerfect))
+	{
+		return entry.colMove;
+	}
+
+	// the solver's best move is best for sure
+	if (m_pSettings->difficulty == mconst_difficultyPerfect
+	    && m_cMoves >= mconst_solveMovesMin)
+	{
+		return Solver::solveMoves( m_position, rgScores );
+	}
 
-	// the list of valid moves, 'best' move first (descending static value)
+	// the list of valid moves, 'best' move first (best static value for
+	// whoever is to move)
 	int rgMoves[] = {3, 2, 4, 1, 5, 0, 6};
 	int movesLim = sizeof( rgMoves ) / sizeof( int );
-	descendMoves( rgMoves, movesLim );
-
-    // as a default set the best and second best to the statically best move
-	bestmove = secondbestmove = rgMoves[ 0 ];
+	sortMoves( rgMoves, movesLim );
+
+	// In a position that is its own mirror image, such as the empty board,
+	// each move right of centre is as good as its mirror image on the left,
+	// so only the centre and the left need searching; the move chosen is
+	// mirrored half the time, so that the right is played as often.
+	int rgMovesSearch[ MAGIC_LIMIT_COLS ];
+	int movesLimSearch = 0;
+	int fSymmetric = m_position.isSymmetric();
+	int colMove;
 
-    // for each move in the rgMoves array, evaluate the move
-	for(iMoves = 0; iMoves < movesLim; iMoves++)
+	for (iMoves = 0; iMoves < movesLim; iMoves++)
 	{
-		move( rgMoves[ iMoves ] );
-		temp = isGameOver() ? m_sumStatEval
-		                  : calcMinEval( m_depthMax, alpha, mconst_bestEval );
-		remove();
-
-		if (best < temp)
+		if (!fSymmetric || rgMoves[ iMoves ] <= 3)
 		{
-			best = alpha = temp;
-			secondbestmove = bestmove;
-			bestmove = rgMoves[ iMoves ];
+			rgMovesSearch[ movesLimSearch++ ] = rgMoves[ iMoves ];
 		}
 	}
-    // get results from threads here.
+
+	searchDeepening( rgMovesSearch, movesLimSearch, bestmove, secondbestmove );
 
     // select randomly which move to return
 	randomchance = rand() / (1.0 + (double)RAND_MAX);
-	if ( randomchance < m_chancePickBest )
+	if ( randomchance < m_pSettings->chancePickBest )
 	{
-		return bestmove;
+		colMove = bestmove;
 	}
-	else if ( randomchance < m_chancePickBest + m_chancePickSecondBest )
+	else if ( randomchance < m_pSettings->chancePickBest
+	                         + m_pSettings->chancePickSecondBest )
 	{
-		return secondbestmove;
+		colMove = secondbestmove;
 	}
 	else
 	{
+		// any valid move, on either side
 		randomchance = rand() / (1.0 + (double)RAND_MAX);
 		return rgMoves[ (int) (randomchance * movesLim) ];
 	}
+
+	if (fSymmetric && rand() % 2)
+	{
+		colMove = MAGIC_LIMIT_COLS - 1 - colMove;
+	}
+	return colMove;
 }
 
-int Board::calcMinMove(void)
+// Searches the (already sorted) root moves to the depth of the difficulty
+// or, if there is a time budget, iteratively: to depth 1, then 2, and so on
+// until time runs out, keeping the result of the last search to finish.
+// Each search starts with the previous best move, and the transposition
+// table holds the best replies found below it, so every iteration starts on
+// the previous one's principal variation.
+//
+// The value at one depth swings from the value one ply shallower, as each
+// ply gives the side to move one more piece, but is usually near the value
+// two ply shallower. So each iteration after the second is searched in an
+// aspiration window around the value the one before last found. A search to
+// a fixed depth does the same with the value the search for the last move
+// left in the transposition table for this position, if any.
+void Board::searchDeepening( int* rgMoves, int movesLim,
+                             int &bestmove, int &secondbestmove )
 {
-	// the root is min, and therefore has a beta value
-	int iMoves;
-	int temp;
-	int beta = mconst_bestEval;
-	int best = mconst_bestEval + 1;
-	int bestmove;
-	int secondbestmove;
-	double randomchance;
+	SearchLimit limit;
+	long long nsStart, nsBudget;
+	int depth, depthLim;
+	int best, bestPrev;
+	int bestmoveDepth, secondbestmoveDepth, bestDepth;
+	TransEntry entry;
+	unsigned long long key;
+
+	if (!m_msMoveTime)
+	{
+		// the search for the last move has usually left a value for this
+		// position in the transposition table
+		key = (m_keyMirror < m_key) ? m_keyMirror : m_key;
+		if (TransTable::probe( key, m_pSettings->difficulty, entry )
+		    && entry.bound == TransTable::mconst_boundExact
+		    && (entry.depth - m_pSettings->depthMax) % 2 == 0)
+		{
+			searchGuess( rgMoves, movesLim, m_pSettings->depthMax,
+			             entry.eval, best, bestmove, secondbestmove );
+		}
+		else if (m_driver == mconst_driverMtdf)
+		{
+			// MTD(f) needs some guess, and an even one is nearest the
+			// eventual value most often
+			searchMtdf( rgMoves, movesLim, m_pSettings->depthMax, 0,
+			            best, bestmove, secondbestmove );
+		}
+		else
+		{
+			searchRoot( rgMoves, movesLim, m_pSettings->depthMax,
+			            mconst_worstEval, mconst_bestEval,
+			            best, bestmove, secondbestmove );
+		}
+		return;
+	}
 
-	// the list of valid moves, 'best' move first (descending static value)
-	int rgMoves[] = {3, 2, 4, 1, 5, 0, 6};
-	int movesLim = sizeof( rgMoves ) / sizeof( int );
-	ascendMoves( rgMoves, movesLim );
+	nsStart = nsNow();
+	nsBudget = m_msMoveTime * 1000000LL;
 
-	bestmove = secondbestmove = rgMoves[ 0 ];
+	// there is no point searching past the end of the game
+	depthLim = mconst_posLim - m_cMoves - 1;
+
+	// the first iteration is quick, and must finish to have a move at all
+	limit.nsDeadline = 0;
+	__atomic_store_n( &limit.fStop, 0, __ATOMIC_RELAXED );
+	m_pLimit = &limit;
 
-	for(iMoves = 0; iMoves < movesLim; iMoves++)
+	searchRoot( rgMoves, movesLim, 1, mconst_worstEval, mconst_bestEval,
+	            best, bestmove, secondbestmove );
+	bestPrev = best;
+	limit.nsDeadline = nsStart + nsBudget;
+
+	for (depth = 2; depth <= depthLim; depth++)
 	{
-		move( rgMoves[ iMoves ] );
+		// the next iteration would take longer than all of these together
+		if (nsNow() - nsStart > nsBudget / 2)
+		{
+			break;
+		}
 
-		temp = isGameOver() ? m_sumStatEval
-		                  : calcMaxEval( m_depthMax, mconst_worstEval, beta );
+		firstMove( rgMoves, movesLim, bestmove );
 
-		remove();
+		if (depth == 2)
+		{
+			if (!searchRoot( rgMoves, movesLim, depth,
+			                 mconst_worstEval, mconst_bestEval,
+			                 bestDepth, bestmoveDepth, secondbestmoveDepth ))
+			{
+				break;
+			}
+		}
+		else if (!searchGuess( rgMoves, movesLim, depth, bestPrev,
+		                       bestDepth, bestmoveDepth, secondbestmoveDepth ))
+		{
+			break;
+		}
 
-		if (best > temp)
+		bestPrev = best;
+		best = bestDepth;
+		bestmove = bestmoveDepth;
+		secondbestmove = secondbestmoveDepth;
+	}
+
+	m_pLimit = NULL;
+}
+
+// searches the root moves for a value expected to be near evalGuess, with
+// whichever driver is set
+int Board::searchGuess( int* rgMoves, int movesLim, int depth,
+                        int evalGuess, int &best,
+                        int &bestmove, int &secondbestmove )
+{
+	if (m_driver == mconst_driverMtdf)
+	{
+		return searchMtdf( rgMoves, movesLim, depth, evalGuess,
+		                   best, bestmove, secondbestmove );
+	}
+
+	return searchAspiration( rgMoves, movesLim, depth, evalGuess,
+	                         best, bestmove, secondbestmove );
+}
+
+// Searches the root moves in a window of mconst_aspirationWindow either side
+// of evalGuess, the value the search is expected to find.  A value outside
+// the window is only a bound, so the search is then repeated with the window
+// opened up on that side.  Returns 0 if the time ran out.
+int Board::searchAspiration( int* rgMoves, int movesLim, int depth,
+                             int evalGuess, int &best,
+                             int &bestmove, int &secondbestmove )
+{
+	int alpha = evalGuess - mconst_aspirationWindow;
+	int beta = evalGuess + mconst_aspirationWindow;
+
+	for (;;)
+	{
+		if (!searchRoot( rgMoves, movesLim, depth, alpha, beta,
+		                 best, bestmove, secondbestmove ))
 		{
-			best = beta = temp;
-			secondbestmove = bestmove;
-			bestmove = rgMoves[ iMoves ];
+			return 0;
 		}
+
+		if (best <= alpha && alpha > mconst_worstEval)
+		{
+			alpha = mconst_worstEval;
+		}
+		else if (best >= beta && beta < mconst_bestEval)
+		{
+			beta = mconst_bestEval;
+		}
+		else
+		{
+			return 1;
+		}
+
+		firstMove( rgMoves, movesLim, bestmove );
 	}
+}
 
-	randomchance = rand() / (1.0 + (double)RAND_MAX);
-	if ( randomchance < m_chancePickBest )
+// MTD(f): searches the root moves with null windows only, each of which
+// shows that the value is below it or at least above it, starting from
+// evalGuess and closing in from both sides until the bounds meet. Every
+// search returns the bound it proved (fail-soft), so each one can move a
+// long way, and the nodes it visits are left in the transposition table for
+// the next. The best move is that of the last search to prove a lower bound,
+// as a search that fails low proves nothing about which move is best.
+// Returns 0 if the time ran out.
+int Board::searchMtdf( int* rgMoves, int movesLim, int depth,
+                       int evalGuess, int &best,
+                       int &bestmove, int &secondbestmove )
+{
+	int lower = mconst_worstEval;
+	int upper = mconst_bestEval;
+	int beta;
+	int bestmovePass, secondbestmovePass;
+
+	best = evalGuess;
+	bestmove = secondbestmove = rgMoves[ 0 ];
+
+	while (lower < upper)
 	{
-		return bestmove;
+		beta = (best == lower) ? best + 1 : best;
+
+		if (!searchRoot( rgMoves, movesLim, depth, beta - 1, beta,
+		                 best, bestmovePass, secondbestmovePass ))
+		{
+			return 0;
+		}
+
+		if (best < beta)
+		{
+			upper = best;
+		}
+		else
+		{
+			lower = best;
+			bestmove = bestmovePass;
+			secondbestmove = secondbestmovePass;
+		}
+
+		firstMove( rgMoves, movesLim, bestmove );
 	}
-	else if ( randomchance < m_chancePickBest + m_chancePickSecondBest )
+
+	return 1;
+}
+
+// Searches the (already sorted) root moves in the window alpha to beta, with
+// one task per thread of the search pool, the calling thread running one of
+// them. best is set to the value found, which is only a bound if it is
+// outside the window. As a default the best and second best are the
+// statically best move; otherwise the second best is whichever move was
+// best before the best one was found, as in a serial search. Returns 0 if
+// the time ran out before the search finished.
+int Board::searchRoot( int* rgMoves, int movesLim, int depth,
+                       int alpha, int beta, int &best,
+                       int &bestmove, int &secondbestmove )
+{
+	RootSearch search;
+	SearchGroup group;
+	int cTasks = SearchPool::getThreads();
+	int iTasks;
+
+	pthread_mutex_init( &search.mutex, NULL );
+	search.pBoard = this;
+	search.rgMoves = rgMoves;
+	search.movesLim = movesLim;
+	search.iMoveNext = 0;
+	search.depth = depth;
+	search.alpha = alpha;
+	search.beta = beta;
+	search.best = mconst_worstEval - 1;
+	search.iBest = movesLim;
+	search.bestmove = search.secondbestmove = rgMoves[ 0 ];
+	search.cNodes = 0;
+
+	// more tasks than root moves would have nothing to do
+	if (cTasks > movesLim)
 	{
-		return secondbestmove;
+		cTasks = movesLim;
 	}
-	else
+
+	// The eldest root move is searched first, on its own, so that the rest
+	// have a value to be proven no better than, as below the root; its
+	// subtree is still shared out at the split points in it.
+	search.movesLim = 1;
+	searchRootTask( &search );
+	search.movesLim = movesLim;
+	search.iMoveNext = 1;
+
+	for (iTasks = 1; iTasks < cTasks; iTasks++)
 	{
-		randomchance = rand() / (1.0 + (double)RAND_MAX);
-		return rgMoves[ (int) (randomchance * movesLim) ];
+		SearchPool::submit( group, searchRootTask, &search );
 	}
+
+	searchRootTask( &search );
+	SearchPool::wait( group );
+
+	pthread_mutex_destroy( &search.mutex );
+
+	m_cNodes += search.cNodes;
+	best = search.best;
+	bestmove = search.bestmove;
+	secondbestmove = search.secondbestmove;
+
+	return !isAborted();
 }
 
-int Board::calcMaxEval( int depth, int alpha, int beta )
+// the body of each root search task
+void Board::searchRootTask( void* pvSearch )
 {
+	RootSearch* pSearch = (RootSearch*)pvSearch;
+	Board board( *pSearch->pBoard );
+	int sign = board.m_fIsComputerTurn ? 1 : -1;
 	int iMoves;
+	int alpha;
+	int beta = pSearch->beta;
 	int temp;
-	int best = mconst_worstEval;
+	int fScout;
 
-	// the list of valid moves, 'best' move first (descending static value)
-	int rgMoves[] = {3, 2, 4, 1, 5, 0, 6};
-	int movesLim = sizeof( rgMoves ) / sizeof( int );
+	board.m_cNodes = 0;
 
-	// if this is the end of the tree (depth now 0)
-	if (! (--depth))
-	{                 
-		for (int iMoves = 0; iMoves < movesLim; iMoves++)
-        {
-            if (!m_rgPosition[ iMoves ])
-            {
-                move( iMoves );
-                
-                if (m_sumStatEval > best)
-                {
-                    best = m_sumStatEval;
-                }
-
-                remove();
-            }
-        }
-	}
-	else
+	for (;;)
 	{
-		descendMoves(rgMoves, movesLim);
-
-		// cut branching factor to mconst_branchFactorMax
-		movesLim = (movesLim > mconst_branchFactorMax)
-		           ? mconst_branchFactorMax : movesLim;
-
-		// for every daughter
-		for(iMoves = 0; iMoves < movesLim; iMoves++)
+		pthread_mutex_lock( &pSearch->mutex );
+		iMoves = pSearch->iMoveNext++;
+		alpha = pSearch->alpha;
+		fScout = pSearch->iBest < pSearch->movesLim;
+		pthread_mutex_unlock( &pSearch->mutex );
+
+		// a move at least as good as beta ends the search, as in calcEval()
+		if (iMoves >= pSearch->movesLim || alpha >= beta || board.isAborted())
 		{
-			move( rgMoves[ iMoves ]);
-			temp = isGameOver() ? m_sumStatEval
-			                    : calcMinEval( depth, best, beta );
-			remove();
+			break;
+		}
 
-			if (best < temp)
+		board.move( pSearch->rgMoves[ iMoves ] );
+		if (board.isGameOver())
+		{
+			temp = sign * board.m_sumStatEval;
+		}
+		else if (!fScout)
+		{
+			temp = -board.calcEval( pSearch->depth, -beta, -alpha );
+		}
+		else
+		{
+			// Once one root move has a value, the rest get a null window
+			// first, as in calcEval(). Until then there is no alpha worth
+			// proving anything against.
+			temp = -board.calcEval( pSearch->depth, -alpha - 1, -alpha );
+			if (temp > alpha && temp < beta && !board.isAborted())
 			{
-				best = temp;
-				
-				// Check for an alphabeta "prune" of the tree. Early exit
-				// because max has a position here that is better than another
-				// position which min could choose, so min would never allow.
-				if (temp >= beta)
-				{
-					break;
-				}
+				temp = -board.calcEval( pSearch->depth, -beta, -alpha );
 			}
-		}		  					 
+		}
+		board.remove();
+
+		// out of time, so this search won't be used
+		if (board.isAborted())
+		{
+			break;
+		}
+
+		pthread_mutex_lock( &pSearch->mutex );
+
+		// A value that is no better than the alpha it was searched with is
+		// only a bound itself, so on a tie it can't displace an exact value.
+		// An exact tie goes to the earlier move, as it would serially.
+		if (pSearch->best < temp
+		    || ( pSearch->best == temp && temp > alpha
+		         && iMoves < pSearch->iBest ))
+		{
+			pSearch->best = pSearch->alpha = temp;
+			pSearch->iBest = iMoves;
+			pSearch->secondbestmove = pSearch->bestmove;
+			pSearch->bestmove = pSearch->rgMoves[ iMoves ];
+		}
+
+		pthread_mutex_unlock( &pSearch->mutex );
 	}
 
-	return best;
+	__atomic_add_fetch( &pSearch->cNodes, board.m_cNodes, __ATOMIC_RELAXED );
 }
 
-int Board::calcMinEval( int depth, int alpha, int beta )
+// Returns the value of the position to whoever is to move (negamax), so
+// max's values are m_sumStatEval and mini's are its negation. The value is
+// searched for within the window alpha to beta: if it is no more than alpha,
+// or at least beta, what is returned is only a bound on it.
+int Board::calcEval( int depth, int alpha, int beta )
 {
-	// start off assuming the worst for min
 	int iMoves;
 	int temp;
-	int best = mconst_bestEval;
-	
-	// the list of valid moves, 'best' move first (descending static value)
+	int best = mconst_worstEval;
+	int colBest = mconst_colNil;
+	int alphaOrig = alpha;
+	int sign = m_fIsComputerTurn ? 1 : -1;
+	TransEntry entry;
+	unsigned long long key;
+	unsigned long long moves;
+	int fMirrored;
+	int branchFactor;
+
+	// the list of valid moves, 'best' move first (best static value for
+	// whoever is to move)
 	int rgMoves[] = {3, 2, 4, 1, 5, 0, 6};
 	int movesLim = sizeof( rgMoves ) / sizeof( int );
 
 	// if this is the end of the tree (depth now 0)
 	if (! (--depth))
-	{                 
-		for (iMoves = 0; iMoves < movesLim; iMoves++)
+	{
+		best = calcStatEvalBest();
+	}
+	else
+	{
+		if (!(++m_cNodes & (mconst_nodesPerClockCheck - 1)) && m_pLimit)
 		{
-			if (!m_rgPosition[ iMoves ])
-			{
-				move( iMoves );
+			checkLimit();
+		}
 
-				if (m_sumStatEval < best)
+		// A move that wins at once is better than anything a search could
+		// find, so the value is that of the best such move.
+		moves = m_position.getWinningMoves();
+		if (moves)
+		{
+			for (iMoves = 0; iMoves < movesLim; iMoves++)
+			{
+				if ((moves & Position::columnMask( rgMoves[ iMoves ] ))
+				    && sign * calcStatEvalAfter( rgMoves[ iMoves ] ) > best)
 				{
-					best = m_sumStatEval;
-	         	}
+					best = sign * calcStatEvalAfter( rgMoves[ iMoves ] );
+				}
+			}
 
-				remove();
+			return best;
+		}
+
+		// a position and its mirror image share an entry, under the lesser
+		// of their keys, with the best move as it is in that one; entries of
+		// other difficulties, which search differently, aren't used
+		key = m_key;
+		fMirrored = m_keyMirror < m_key;
+		if (fMirrored)
+		{
+			key = m_keyMirror;
+		}
+
+		entry.colMove = mconst_colNil;
+		if (TransTable::probe( key, m_pSettings->difficulty, entry )
+		    && entry.depth >= depth)
+		{
+			if (entry.bound == TransTable::mconst_boundExact
+			    || (entry.bound == TransTable::mconst_boundLower
+			        && entry.eval >= beta)
+			    || (entry.bound == TransTable::mconst_boundUpper
+			        && entry.eval <= alpha))
+			{
+				return entry.eval;
 			}
 		}
-	}
-	else
-	{
-		ascendMoves( rgMoves, movesLim );
 
-		// cut branching factor to mconst_branchFactorMax
-		movesLim = (movesLim > mconst_branchFactorMax)
-		           ? mconst_branchFactorMax : movesLim;
+		if (fMirrored && entry.colMove != mconst_colNil)
+		{
+			entry.colMove = 6 - entry.colMove;
+		}
+
+		sortMoves( rgMoves, movesLim );
+		firstMove( rgMoves, movesLim, entry.colMove );
+		dropLosingMoves( rgMoves, movesLim );
+
+		// cut the branching factor, more sharply before the late game
+		branchFactor = (m_cMoves >= m_pSettings->movesLate)
+		               ? m_pSettings->branchFactorLate
+		               : m_pSettings->branchFactor;
+		movesLim = (movesLim > branchFactor) ? branchFactor : movesLim;
 
 		// for every daughter
 		for(iMoves = 0; iMoves < movesLim; iMoves++)
 		{
-			move( rgMoves[ iMoves ] );
-			temp = isGameOver() ? m_sumStatEval
-			                    : calcMaxEval( depth, alpha, best );
+			// the eldest brother has been searched, so share out the rest
+			if (iMoves == 1 && depth >= mconst_splitDepthMin
+			    && !m_fReduced && SearchPool::getIdle())
+			{
+				splitMoves( rgMoves + 1, movesLim - 1, depth, alpha, beta,
+				            best, colBest );
+				break;
+			}
+
+#if MAGIC_COPY_MAKE
+			Board daughter( *this );
+#else
+			Board &daughter = *this;
+#endif
+
+			daughter.move( rgMoves[ iMoves ] );
+			if (daughter.isGameOver())
+			{
+				temp = sign * daughter.m_sumStatEval;
+			}
+			else if (!iMoves)
+			{
+				temp = -daughter.calcEval( depth, -beta, -alpha );
+			}
+			else
+			{
+				temp = daughter.calcEvalBrother( depth, alpha, beta, iMoves );
+			}
+
+#if MAGIC_COPY_MAKE
+			// the copy counted its nodes on from ours
+			m_cNodes = daughter.m_cNodes;
+#else
 			remove();
+#endif
+
+			// a split point above has been pruned, or time is up, so
+			// nobody wants this
+			if (isAborted())
+			{
+				break;
+			}
 
-			if (best > temp)
+			if (best < temp)
 			{
 				best = temp;
-				
-				// Check for an alphabeta "prune" of the tree. Early exit
-				// because max has a position here that is better than another
-				// position which min could choose, so min would never allow.
-				if (temp <= alpha)
+				colBest = rgMoves[ iMoves ];
+
+				if (best > alpha)
 				{
-					break;
+					alpha = best;
+
+					// Check for an alphabeta "prune" of the tree. Early exit
+					// because the mover has a position here that is better
+					// than another position which the opponent could choose
+					// higher up, so the opponent would never allow it.
+					if (alpha >= beta)
+					{
+						break;
+					}
 				}
 			}
 		}
+
+		// a value from abandoned work is worthless
+		if (!isAborted())
+		{
+			if (fMirrored && colBest != mconst_colNil)
+			{
+				colBest = 6 - colBest;
+			}
+
+			TransTable::store( key, m_pSettings->difficulty, m_generation,
+			                   depth,
+			                   (best <= alphaOrig) ? TransTable::mconst_boundUpper
+			                   : (best >= beta) ? TransTable::mconst_boundLower
+			                   : TransTable::mconst_boundExact, best, colBest );
+		}
 	}
 
 	return best;
 }
 
-void Board::descendMoves( int* moves, int &movesLim )
+// Returns the value, to the parent, of the daughter whose move has just been
+// made, the iMoves'th (from 0) of the parent's daughters, which are searched
+// in the window alpha to beta. depth is that passed on to the daughters.
+//
+// The eldest brother is most likely best, so this one is first only proven
+// to be no better, with a null window, and searched properly only if it is
+// (principal variation search). The brothers after the first reduceMovesMin
+// of the difficulty (see mconst_rgSettings) are less likely still to be any
+// good, so they are first proven no better with a search mconst_reduction
+// plies shallower, and searched to the full depth only if that fails (late
+// move reduction).
+int Board::calcEvalBrother( int depth, int alpha, int beta, int iMoves )
 {
-	int i = 0;
-	int j;
 	int temp;
-	int *statvals;
-	int bigval, bigindex;
+	int fReduced = m_fReduced;
 
-	statvals = (int *)calloc(movesLim,sizeof(int));
+	if (iMoves >= m_pSettings->reduceMovesMin
+	    && depth >= mconst_reduceDepthMin)
+	{
+		// most reduced searches fail low at once, so their nodes aren't
+		// worth the copies and waiting of splitting them (see calcEval())
+		m_fReduced = 1;
+		temp = -calcEval( depth - mconst_reduction, -alpha - 1, -alpha );
+		m_fReduced = fReduced;
+		if (temp <= alpha || isAborted())
+		{
+			return temp;
+		}
+	}
 
-	while (i < movesLim)
+	temp = -calcEval( depth, -alpha - 1, -alpha );
+	if (temp > alpha && temp < beta && !isAborted())
 	{
-		// if the column of move i is full, take it off the list
-		// by reducing size and copying the last element into its place
-		if (m_rgPosition[ moves[ i ] ])  
+		temp = -calcEval( depth, -beta, -alpha );
+	}
+
+	return temp;
+}
+
+// Makes this node a split point for the daughters in rgMoves, which are
+// searched by this thread and by any thread that steals one of its tasks.
+// best is the value of the daughters already searched, and colBest the
+// daughter with that value; both are updated once every task has finished.
+void Board::splitMoves( int* rgMoves, int movesLim, int depth,
+                        int alpha, int beta, int &best, int &colBest )
+{
+	SplitPoint split;
+	SearchGroup group;
+	int iTasks;
+
+	pthread_mutex_init( &split.mutex, NULL );
+	split.board = *this;
+	split.pParent = m_pSplit;
+	split.rgMoves = rgMoves;
+	split.movesLim = movesLim;
+	__atomic_store_n( &split.iMoveNext, 0, __ATOMIC_RELAXED );
+	split.depth = depth;
+	split.alpha = (best > alpha) ? best : alpha;
+	split.beta = beta;
+	split.best = best;
+	split.colBest = colBest;
+	__atomic_store_n( &split.fCutoff, 0, __ATOMIC_RELAXED );
+	split.cNodes = 0;
+
+	// the owner is sure to search at least one of the daughters itself
+	for (iTasks = 1; iTasks < movesLim; iTasks++)
+	{
+		SearchPool::submit( group, searchSplitTask, &split );
+	}
+
+	m_pSplit = &split;
+	searchSplit( &split );
+	m_pSplit = split.pParent;
+
+	SearchPool::wait( group );
+	pthread_mutex_destroy( &split.mutex );
+
+	m_cNodes += split.cNodes;
+	best = split.best;
+	colBest = split.colBest;
+}
+
+// the body of each helping task
+void Board::searchSplitTask( void* pvSplit )
+{
+	SplitPoint* pSplit = (SplitPoint*)pvSplit;
+
+	// Tasks that weren't stolen are run by the owner once it has searched
+	// every daughter itself, so don't copy the board just to find that out.
+	if (__atomic_load_n( &pSplit->iMoveNext, __ATOMIC_ACQUIRE )
+	    >= pSplit->movesLim
+	    || __atomic_load_n( &pSplit->fCutoff, __ATOMIC_ACQUIRE ))
+	{
+		return;
+	}
+
+	Board board( pSplit->board );
+
+	board.m_pSplit = pSplit;
+	board.m_cNodes = 0;
+	board.searchSplit( pSplit );
+
+	__atomic_add_fetch( &pSplit->cNodes, board.m_cNodes, __ATOMIC_RELAXED );
+}
+
+// Searches daughters of the split point until there are none left or one of
+// them causes a prune. This board must be at the split point's node.
+void Board::searchSplit( SplitPoint* pSplit )
+{
+	int sign = m_fIsComputerTurn ? 1 : -1;
+	int iMoves;
+	int alpha;
+	int temp;
+
+	for (;;)
+	{
+		// taken under the lock, but read without it by searchSplitTask()
+		pthread_mutex_lock( &pSplit->mutex );
+		iMoves = __atomic_fetch_add( &pSplit->iMoveNext, 1,
+		                             __ATOMIC_ACQ_REL );
+		alpha = pSplit->alpha;
+		pthread_mutex_unlock( &pSplit->mutex );
+
+		if (iMoves >= pSplit->movesLim || isAborted())
+		{
+			break;
+		}
+
+		// every daughter here has an elder brother, the one searched
+		// before the split, so is the (iMoves + 1)th of its node
+		move( pSplit->rgMoves[ iMoves ] );
+		if (isGameOver())
 		{
-			moves[ i ] = moves[ movesLim - 1 ];
-			movesLim--;
+			temp = sign * m_sumStatEval;
 		}
 		else
 		{
-			move( moves[ i ] );
-			statvals[ moves[ i ] ] = m_sumStatEval;
-			remove();
-			i++;
+			temp = calcEvalBrother( pSplit->depth, alpha, pSplit->beta,
+			                        iMoves + 1 );
 		}
-	}
-
-	// sorting algorithm
-	for (i = 0; i < movesLim - 1; i++)
-	{
-		bigval = statvals[ moves[ i ] ];
-		bigindex = 0;
+		remove();
 
-		for (j = i + 1; j < movesLim; j++)
-		if (statvals[ moves[ j ] ] > bigval)
+		if (isAborted())
 		{
-			bigval = statvals[ moves[ j ] ];
-			bigindex = j;
+			break;
 		}
 
-		if (bigindex)
+		pthread_mutex_lock( &pSplit->mutex );
+
+		if (pSplit->best < temp)
 		{
-			temp = moves[ i ];
-			moves[ i ] = moves[ bigindex ];
-			moves[ bigindex ] = temp;
+			pSplit->best = temp;
+			pSplit->colBest = pSplit->rgMoves[ iMoves ];
+
+			if (temp > pSplit->alpha)
+			{
+				pSplit->alpha = temp;
+
+				if (temp >= pSplit->beta)
+				{
+					__atomic_store_n( &pSplit->fCutoff, 1,
+					                  __ATOMIC_RELEASE );
+				}
+			}
 		}
+
+		pthread_mutex_unlock( &pSplit->mutex );
 	}
-	free(statvals);
 }
 
-void Board::ascendMoves( int* moves, int &movesLim )
+// stop the search if its time is up
+void Board::checkLimit( void )
 {
-	int i = 0;
-	int j;
-	int temp;
-	int *statvals;
-	int smallval, smallindex;
+	if (m_pLimit->nsDeadline && nsNow() >= m_pLimit->nsDeadline)
+	{
+		__atomic_store_n( &m_pLimit->fStop, 1, __ATOMIC_RELEASE );
+	}
+}
 
-	statvals = (int *)calloc(movesLim,sizeof(int));
+// returns 1 if the time is up, or if the split point being helped, or any
+// above it, has been pruned
+int Board::isAbortedAbove( void )
+{
+	SplitPoint* pSplit;
 
-	while (i < movesLim)
+	if (m_pLimit && __atomic_load_n( &m_pLimit->fStop, __ATOMIC_ACQUIRE ))
 	{
-		// if the column of move i is full, take it off the list
-		// by reducing size and copying the last element into its place
-		if (m_rgPosition[ moves[ i ] ])
+		return 1;
+	}
+
+	for (pSplit = m_pSplit; pSplit; pSplit = pSplit->pParent)
+	{
+		if (__atomic_load_n( &pSplit->fCutoff, __ATOMIC_ACQUIRE ))
 		{
-			moves[ i ] = moves[ movesLim - 1 ];
-			movesLim--;
+			return 1;
 		}
-		else
+	}
+
+	return 0;
+}
+
+// if colMove is one of the moves, move it to the front, keeping the others
+// in order
+void Board::firstMove( int* moves, int movesLim, int colMove )
+{
+	int i;
+
+	for (i = 0; i < movesLim; i++)
+	{
+		if (moves[ i ] == colMove)
 		{
-			move( moves[ i ] );
-			statvals[ moves[ i++ ] ] = m_sumStatEval;
-			remove();
+			for (; i > 0; i--)
+			{
+				moves[ i ] = moves[ i - 1 ];
+			}
+			moves[ 0 ] = colMove;
+			break;
 		}
 	}
+}
+
+// Takes off the list of moves those that let the opponent win with the next
+// move: all but the one that blocks the opponent's four, if there is one,
+// and those that would let the opponent drop a piece onto a square that
+// gives them four. The player to move must not be able to win at once. If
+// every move loses, the first is kept, so that there is a value to return.
+void Board::dropLosingMoves( int* moves, int &movesLim )
+{
+	unsigned long long nonLosing = m_position.getNonLosingMoves();
+	int i;
+	int cMoves = 0;
 
-	// sorting algorithm
-	for (i = 0; i < movesLim - 1; i++)
+	if (!nonLosing)
 	{
-		smallval = statvals[ moves[ i ] ];
-		smallindex = 0;
+		movesLim = (movesLim > 1) ? 1 : movesLim;
+		return;
+	}
 
-		for (j = i + 1; j < movesLim; ++j)
-		if (statvals[ moves[ j ] ] < smallval)
+	for (i = 0; i < movesLim; i++)
+	{
+		if (nonLosing & Position::columnMask( moves[ i ] ))
 		{
-			smallval = statvals[ moves[ j ] ];
-			smallindex = j;
+			moves[ cMoves++ ] = moves[ i ];
+		}
+	}
+	movesLim = cMoves;
+}
+
+// Takes the full columns off the list of moves, and sorts the rest by the
+// static value of the position after each, best for whoever is to move
+// first. Ties keep their order in the list. The values are read off the
+// quads without making the moves, as this runs at every interior node.
+void Board::sortMoves( int* moves, int &movesLim )
+{
+	int i, j;
+	int cMoves = 0;
+	int col, statval;
+	int statvals[ MAGIC_LIMIT_COLS ];
+	int rgEval[ MAGIC_LIMIT_COLS ];
+	int sign = m_fIsComputerTurn ? 1 : -1;
+	unsigned long long possible = calcStatEvalMoves( rgEval );
+
+	// insertion sort, skipping the full columns
+	for (i = 0; i < movesLim; i++)
+	{
+		col = moves[ i ];
+		if (!(possible & Position::columnMask( col )))
+		{
+			continue;
 		}
 
-		if (smallindex)
+		statval = sign * rgEval[ col ];
+		for (j = cMoves; j > 0 && statvals[ j - 1 ] < statval; j--)
 		{
-			temp = moves[ i ];
-			moves[ i ] = moves[ smallindex ];
-			moves[ smallindex ] = temp;
+			moves[ j ] = moves[ j - 1 ];
+			statvals[ j ] = statvals[ j - 1 ];
 		}
+		moves[ j ] = col;
+		statvals[ j ] = statval;
+		cMoves++;
 	}
-	free(statvals);
+	movesLim = cMoves;
 }
 
 
@@ -868,30 +1972,46 @@ void Board::ascendMoves( int* moves, int &movesLim )
 
 
 
-/****** The posquad data above was generated by this old code ****************
+/****** The posquad and quadsperpos data above were generated by this old code
 
 #include <iostream.h>
 
 void updatequad(int quad);
 void test(int row, int col);
 
+int cQuads;  // quads printed so far in the current row
+
 void main(void)
 {
 	int row, col;
+	int rgcQuads[42];
 	for (row = 0; row < 6; ++row)
 	{
 		for (col = 0; col < 7; ++col)
 		{
 			cout << "{";
+			cQuads = 0;
 			test(row, col);
-			cout << "0}, ";
+			cout << "}, ";
+			rgcQuads[7 * row + col] = cQuads;
 		}
 	}
+
+	// the counts, for quadsperpos
+	cout << endl;
+	for (row = 0; row < 6; ++row)
+	{
+		for (col = 0; col < 7; ++col)
+			cout << rgcQuads[7 * row + col] << ", ";
+		cout << endl;
+	}
 }
 
 void updatequad(int quad)
 {
-	cout << quad + 1 << ", ";
+	if (cQuads++)
+		cout << ", ";
+	cout << quad + 1;
 }
 
 void test(int row, int col)
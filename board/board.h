@@ -21,17 +21,36 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
  */
 
+#include "position.h"
+
 #define MAGIC_LIMIT_POS 42
 #define MAGIC_LIMIT_COLS 7
 #define MAGIC_LIMIT_QUAD 70
 #define MAGIC_LIMIT_QUADCODE 30
-#define MAGIC_LIMIT_QUAD_PER_POS 14
+#define MAGIC_LIMIT_QUAD_PER_POS 13
+#define MAGIC_LIMIT_BITS 49
+#define MAGIC_LIMIT_HISTORY 2
+#define MAGIC_LIMIT_DIFFICULTY 11
+
+// 1 to search each daughter on a copy of the board with its move made
+// (copy-make), 0 to make the move on the board and take it back after
+// (make/unmake); build with -DMAGIC_COPY_MAKE=0 to choose make/unmake
+#ifndef MAGIC_COPY_MAKE
+#define MAGIC_COPY_MAKE 1
+#endif
+
+struct SplitPoint;
+struct SearchLimit;
+struct BoardSettings;
 
 class Board
 {
 public:
 	Board();
+	explicit Board( unsigned long long key );
 	void setDifficulty( int difficulty );
+	void setMoveTime( int msMoveTime );
+	void setDriver( int driver );
 	void setHumanFirst( void );
 	void setComputerFirst( void );
 	int  isComputerWin( void );
@@ -42,8 +61,15 @@ public:
 	int  takeBackMove( void );
     int  getNumMoves( void );
     int  getLastMove( void );
+	unsigned long long getNodes( void );
+	unsigned long long getPositionKey( void );
 	
 	static const int mconst_colNil;
+	static const int mconst_difficultyPerfect;
+	static const int mconst_driverAlphaBeta;
+	static const int mconst_driverMtdf;
+	// set in getPositionKey() when the computer is to move
+	static const unsigned long long mconst_keyComputerTurn;
 	// number of positions or squares on board
 	static const int mconst_posLim         = MAGIC_LIMIT_POS;
 
@@ -57,19 +83,67 @@ public:
 	}
 
 private:
-	int  calcMaxMove( void );
-	int  calcMinMove( void );
-	int  calcMaxEval( int depth, int alpha, int beta );
-	int  calcMinEval( int depth, int alpha, int beta );
-	void descendMoves( int* moves, int &nummoves );
-	void ascendMoves( int* moves, int &nummoves );
+	void clear( void );
+	static int findHistory( Position position, int* rgMoves,
+	                        const int* rgStride, char* rgDead, int iDead );
+	int  calcMove( void );
+	void searchDeepening( int* rgMoves, int movesLim,
+	                      int &bestmove, int &secondbestmove );
+	int  searchGuess( int* rgMoves, int movesLim, int depth,
+	                  int evalGuess, int &best,
+	                  int &bestmove, int &secondbestmove );
+	int  searchAspiration( int* rgMoves, int movesLim, int depth,
+	                       int evalGuess, int &best,
+	                       int &bestmove, int &secondbestmove );
+	int  searchMtdf( int* rgMoves, int movesLim, int depth,
+	                 int evalGuess, int &best,
+	                 int &bestmove, int &secondbestmove );
+	int  searchRoot( int* rgMoves, int movesLim, int depth,
+	                 int alpha, int beta, int &best,
+	                 int &bestmove, int &secondbestmove );
+	static void  searchRootTask( void* pvSearch );
+	void splitMoves( int* rgMoves, int movesLim, int depth,
+	                 int alpha, int beta, int &best, int &colBest );
+	void searchSplit( SplitPoint* pSplit );
+	static void  searchSplitTask( void* pvSplit );
+	void checkLimit( void );
+	int  isAbortedAbove( void );
+
+	// returns 1 if the result of the current search will not be used, as
+	// time is up or a split point above has been pruned
+	inline int isAborted( void )
+	{
+		return (m_pSplit || m_pLimit) && isAbortedAbove();
+	}
+
+	int  calcEval( int depth, int alpha, int beta );
+	int  calcEvalBrother( int depth, int alpha, int beta, int iMoves );
+	void sortMoves( int* moves, int &nummoves );
+	void firstMove( int* moves, int nummoves, int colMove );
+	void dropLosingMoves( int* moves, int &nummoves );
 	void move( int colMove );
 	void remove( void );
+	static unsigned long long squareBit( int square );
 	void updateQuad( int iQuad );
 	void downdateQuad( int iQuad );
+	int  calcStatEvalAfter( int colMove );
+	unsigned long long calcStatEvalMoves( int rgEval[ MAGIC_LIMIT_COLS ] );
+	int  calcStatEvalBest( void );
+	int  getHistory( int iMove );
+	void setHistory( int iMove, int colMove );
+	int  getHeight( int col );
 
 	static const int mconst_defaultDifficulty;
 	static const int mconst_branchFactorMax;
+	static const int mconst_branchFactorEarly;
+	static const int mconst_movesLate;
+	static const int mconst_reduceMovesMin;
+	static const int mconst_reduceDepthMin;
+	static const int mconst_reduction;
+	static const int mconst_splitDepthMin;
+	static const int mconst_nodesPerClockCheck;
+	static const int mconst_solveMovesMin;
+	static const int mconst_aspirationWindow;
 	static const int mconst_worstEval;
 	static const int mconst_bestEval;
 	static const int mconst_quadLim;
@@ -77,20 +151,43 @@ private:
 	static const int mconst_dEvalN1, mconst_dEvalN2, mconst_dEvalN3, mconst_dEvalN4;
 	static const int mconst_evalPositiveWinMin, mconst_evalNegativeWinMin;
 	static const int mconst_quadsPerPosLim;
-	static const int mconst_mpPosQuads[ MAGIC_LIMIT_POS ][ MAGIC_LIMIT_QUAD_PER_POS ];
+	static const unsigned char mconst_mpPosQuads[ MAGIC_LIMIT_POS ][ MAGIC_LIMIT_QUAD_PER_POS ];
+	static const unsigned char mconst_rgQuadsPerPos[ MAGIC_LIMIT_POS ];
+	static const int mconst_mpBitPos[ MAGIC_LIMIT_BITS ];
 	static const int mconst_quadcodeLim;
-	static const int mconst_rgUpQuadcode[ MAGIC_LIMIT_QUADCODE ];
-	static const int mconst_rgDownQuadcode[ MAGIC_LIMIT_QUADCODE ];
+	static const signed char mconst_rgUpQuadcode[ MAGIC_LIMIT_QUADCODE ];
+	static const signed char mconst_rgDownQuadcode[ MAGIC_LIMIT_QUADCODE ];
 	static const int mconst_rgUpEval[ MAGIC_LIMIT_QUADCODE ];
+	static const unsigned long long mconst_rgZobrist[ MAGIC_LIMIT_POS ][ 2 ];
+	static const unsigned long long mconst_zobristComputerTurn;
+	static const BoardSettings mconst_rgSettings[ MAGIC_LIMIT_DIFFICULTY ];
+	static const int mconst_movesPerHistory;
+	static const int mconst_bitsPerHistory;
+	static const int mconst_bitsPerHeight;
 
-	int m_rgPosition[ MAGIC_LIMIT_POS ]; // stores the pieces on the board, described in .cpp
-	int m_rgQuad[ MAGIC_LIMIT_QUAD ];    // stores the quads of the board, described in .cpp
+	// The position and everything that changes with it, first and in as few
+	// bytes as will do (128, two cache lines), as they are what a task
+	// copying the board to search on another thread needs most (see
+	// searchSplitTask()).  The board has no pointers to itself, so the
+	// implicit copy is a plain copy of bytes.
+	Position m_position;                 // stores the pieces on the board, see position.h
+	unsigned long long m_key;            // Zobrist key of the position, described in .cpp
+	unsigned long long m_keyMirror;      // Zobrist key of its mirror image
+	unsigned long long m_rgHistory[ MAGIC_LIMIT_HISTORY ];  // col's of previous moves, see getHistory()
 	int m_sumStatEval;                   // stores the sum of quad[1..69]
-	int m_rgHistory[ MAGIC_LIMIT_POS ];  // contain col's of previous moves
-	int m_cMoves;                        // stores the number of moves made so far
-	int m_fIsComputerTurn;               // 1 if computer's turn to move, 0 if human's
-	int m_difficulty;                    // from 0 to 9, increasing in difficulty
-	int m_depthMax;                      // ply, no. of moves to search ahead
-	double m_chancePickBest;             // the chance the computer will pick the best move
-	double m_chancePickSecondBest;       // the chance the computer will pick second best move
+	unsigned int m_heights;              // pieces in each column, see getHeight()
+	unsigned char m_cMoves;              // stores the number of moves made so far
+	unsigned char m_fIsComputerTurn;     // 1 if computer's turn to move, 0 if human's
+	unsigned char m_rgQuad[ MAGIC_LIMIT_QUAD ];  // stores the quads of the board, described in .cpp
+
+	// the settings, and the state of the search; those that come with the
+	// difficulty are in a shared table, so a copy only copies a pointer
+	const BoardSettings* m_pSettings;    // what the difficulty sets, one of mconst_rgSettings
+	SplitPoint* m_pSplit;                // innermost split point being helped, or NULL
+	SearchLimit* m_pLimit;               // the time budget of the search, or NULL
+	unsigned long long m_cNodes;         // interior nodes searched, for the clock and getNodes()
+	int m_msMoveTime;                    // time budget per move, 0 for fixed depth
+	unsigned char m_driver;              // how the root is searched, see setDriver()
+	unsigned char m_generation;          // this search's number in the transposition table
+	unsigned char m_fReduced;            // 1 within a reduced search, see calcEvalBrother()
 };
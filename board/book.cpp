@@ -0,0 +1,219 @@
+/*
+ * book.cpp: implements the opening book of Drop Four
+ *
+ * This file is part of Connect 4 Parallel, which is based on "Drop Four".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ */
+
+/*
+ * A book file is a header of two 64-bit words, the magic number and the
+ * number of records, followed by the records, each one 64-bit word in the
+ * byte order of the machine that wrote it:
+ *
+ *   bits  0-7   the score, offset by 128
+ *   bits  8-10  the best move
+ *   bit  11     set if the score is exact
+ *   bits 15-63  the key of the position (Position::getCanonicalKey())
+ *
+ * A position and its mirror image share a record, under the lesser of their
+ * keys, and the best move is the one in the position with that key, so a
+ * book holds about half as many records as there are positions.
+ * The records are sorted, and as the key is in the top bits, sorting them
+ * as numbers sorts them by key.  open() maps the file into memory read-only
+ * and probe() does a binary search of it there, so nothing is read or
+ * copied up front, the pages that are never probed are never read from the
+ * disk, and processes using the same book share its pages.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "book.h"
+
+#define MAGIC_BOOK_MAGIC 0x314b4f4f42345244ULL   // "DR4BOOK1"
+#define MAGIC_BOOK_HEADER 2
+
+static const unsigned long long* g_rgRecords = NULL;
+static size_t g_cRecords = 0;
+static void* g_pvMap = NULL;
+static size_t g_cbMap = 0;
+
+// Maps the book in the file szPath into memory, closing any open book.
+// Returns 0, leaving no book open, if the file can't be read or isn't a
+// book. Not to be called while a search is running.
+int Book::open( const char* szPath )
+{
+	struct stat st;
+	const unsigned long long* pHeader;
+	void* pvMap;
+	int fd;
+
+	close();
+
+	fd = ::open( szPath, O_RDONLY );
+	if (fd < 0)
+	{
+		return 0;
+	}
+
+	if (fstat( fd, &st ) < 0
+	    || (size_t)st.st_size < MAGIC_BOOK_HEADER * sizeof( unsigned long long ))
+	{
+		::close( fd );
+		return 0;
+	}
+
+	pvMap = mmap( NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+	::close( fd );
+	if (pvMap == MAP_FAILED)
+	{
+		return 0;
+	}
+
+	pHeader = (const unsigned long long*)pvMap;
+	if (pHeader[ 0 ] != MAGIC_BOOK_MAGIC
+	    || (MAGIC_BOOK_HEADER + pHeader[ 1 ]) * sizeof( unsigned long long )
+	       != (size_t)st.st_size)
+	{
+		munmap( pvMap, (size_t)st.st_size );
+		return 0;
+	}
+
+	g_pvMap = pvMap;
+	g_cbMap = (size_t)st.st_size;
+	g_rgRecords = pHeader + MAGIC_BOOK_HEADER;
+	g_cRecords = (size_t)pHeader[ 1 ];
+
+	return 1;
+}
+
+// not to be called while a search is running
+void Book::close( void )
+{
+	if (g_pvMap)
+	{
+		munmap( g_pvMap, g_cbMap );
+	}
+
+	g_pvMap = NULL;
+	g_cbMap = 0;
+	g_rgRecords = NULL;
+	g_cRecords = 0;
+}
+
+int Book::isOpen( void )
+{
+	return g_pvMap != NULL;
+}
+
+// returns 1 and fills in entry if the book has the position
+int Book::probe( const Position &position, BookEntry &entry )
+{
+	size_t iLow = 0;
+	size_t iHigh = g_cRecords;
+	size_t iMid;
+	unsigned long long key, keyMid, record;
+	int fMirrored;
+
+	key = position.getCanonicalKey( fMirrored );
+
+	while (iLow < iHigh)
+	{
+		iMid = iLow + (iHigh - iLow) / 2;
+		keyMid = g_rgRecords[ iMid ] >> 15;
+
+		if (keyMid < key)
+		{
+			iLow = iMid + 1;
+		}
+		else if (keyMid > key)
+		{
+			iHigh = iMid;
+		}
+		else
+		{
+			record = g_rgRecords[ iMid ];
+			entry.score = (int)(record & 0xff) - 128;
+			entry.colMove = (int)((record >> 8) & 7);
+			if (fMirrored)
+			{
+				entry.colMove = MAGIC_POSITION_WIDTH - 1 - entry.colMove;
+			}
+			entry.fExact = (int)((record >> 11) & 1);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+// the record to write to a book for the position
+unsigned long long Book::makeRecord( const Position &position,
+                                     const BookEntry &entry )
+{
+	unsigned long long key;
+	int fMirrored;
+	int colMove = entry.colMove;
+
+	key = position.getCanonicalKey( fMirrored );
+	if (fMirrored)
+	{
+		colMove = MAGIC_POSITION_WIDTH - 1 - colMove;
+	}
+
+	return key << 15
+	       | (unsigned long long)(entry.fExact ? 1 : 0) << 11
+	       | (unsigned long long)(colMove & 7) << 8
+	       | (unsigned long long)((entry.score + 128) & 0xff);
+}
+
+static int compareRecords( const void* pv1, const void* pv2 )
+{
+	unsigned long long record1 = *(const unsigned long long*)pv1;
+	unsigned long long record2 = *(const unsigned long long*)pv2;
+
+	return (record1 < record2) ? -1 : (record1 > record2) ? 1 : 0;
+}
+
+// Sorts the records and writes them to szPath as a book. No two records
+// may be for the same position. Returns 0 if the file couldn't be written.
+int Book::write( const char* szPath, unsigned long long* rgRecords,
+                 size_t cRecords )
+{
+	unsigned long long rgHeader[ MAGIC_BOOK_HEADER ];
+	FILE* pFile;
+	int fOk;
+
+	qsort( rgRecords, cRecords, sizeof( unsigned long long ), compareRecords );
+
+	pFile = fopen( szPath, "wb" );
+	if (!pFile)
+	{
+		return 0;
+	}
+
+	rgHeader[ 0 ] = MAGIC_BOOK_MAGIC;
+	rgHeader[ 1 ] = cRecords;
+
+	fOk = fwrite( rgHeader, sizeof( rgHeader ), 1, pFile ) == 1
+	      && fwrite( rgRecords, sizeof( unsigned long long ), cRecords, pFile )
+	         == cRecords;
+
+	return (fclose( pFile ) == 0) && fOk;
+}
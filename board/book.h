@@ -0,0 +1,55 @@
+/*
+ * book.h: header file to the opening book of Drop Four
+ *
+ * This file is part of Connect 4 Parallel, which is based on "Drop Four".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ */
+
+#ifndef BOOK_H
+#define BOOK_H
+
+#include <stddef.h>
+#include "position.h"
+
+#define MAGIC_DEFAULT_BOOK_PATH "drop4.book"
+
+// what the book knows about a position
+struct BookEntry
+{
+	int colMove;               // the best move
+	int score;                 // its value, as the solver gives it, if fExact
+	int fExact;                // 1 if solved, 0 if only searched
+};
+
+// The opening book is a file of positions and their best moves, made by
+// drop4book (dropfour-book.cpp).  Like the transposition table, it is owned
+// by the process: it is mapped into memory once by open(), and from then on
+// any thread may look positions up in it; see the .cpp.
+class Book
+{
+public:
+	static int  open( const char* szPath );
+	static void close( void );
+	static int  isOpen( void );
+	static int  probe( const Position &position, BookEntry &entry );
+
+	static unsigned long long makeRecord( const Position &position,
+	                                      const BookEntry &entry );
+	static int  write( const char* szPath, unsigned long long* rgRecords,
+	                   size_t cRecords );
+};
+
+#endif // BOOK_H
@@ -0,0 +1,366 @@
+/*
+ * position.h: the pieces on a Drop Four board, kept as two bitboards
+ *
+ * This file is part of Connect 4 Parallel, which is based on "Drop Four".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ */
+
+/*
+ * Each column takes seven bits of a 64-bit integer: six for its squares,
+ * from the bottom up, and one always left clear so that runs of pieces
+ * can't spill from the top of one column into the bottom of the next.
+ * Column 0 is bits 0-6, column 1 is bits 7-13, and so on to column 6 at
+ * bits 42-48.  So bit 7 * col + row holds the square in that column and
+ * row, where row 0 is the bottom row.
+ *
+ *     .  .  .  .  .  .  .     <- the clear sentinel row
+ *     5 12 19 26 33 40 47
+ *     4 11 18 25 32 39 46
+ *     3 10 17 24 31 38 45
+ *     2  9 16 23 30 37 44
+ *     1  8 15 22 29 36 43
+ *     0  7 14 21 28 35 42
+ *
+ * A position is two of these: m_mask has a bit set for every piece on the
+ * board, and m_current for the pieces of the player whose turn it is.
+ * Since the pieces in a column are stacked from the bottom, adding the
+ * column's bottom bit to the column's bits of m_mask carries up to the
+ * lowest empty square, which is how play() drops a piece in O(1).
+ *
+ * The same carry gives the lowest empty square of every column at once
+ * (getPossible()), and shifting a player's pieces along each direction
+ * gives every empty square that would complete a four for them
+ * (winningSquares()), which is what the solver (solver.cpp) is built on.
+ */
+
+#ifndef POSITION_H
+#define POSITION_H
+
+#define MAGIC_POSITION_HEIGHT 6
+#define MAGIC_POSITION_WIDTH 7
+
+class Position
+{
+public:
+	Position() : m_current( 0 ), m_mask( 0 ) {}
+
+	// the position whose getKey() is key, which must pass isKey()
+	explicit Position( unsigned long long key ) : m_current( 0 ), m_mask( 0 )
+	{
+		const int bitsPerCol = MAGIC_POSITION_HEIGHT + 1;
+		unsigned long long bits, column;
+		int col;
+
+		// A column of height h has h bits of mask, so its bits of the key
+		// are its pieces of the player to move plus 2^h - 1, which is at
+		// least 2^h - 1 and less than 2^(h + 1) - 1.
+		for (col = 0; col < MAGIC_POSITION_WIDTH; col++)
+		{
+			bits = (key >> (col * bitsPerCol)) & ((1ULL << bitsPerCol) - 1);
+			column = (1ULL << (31 - __builtin_clz( (unsigned)bits + 1 ))) - 1;
+			m_mask |= column << (col * bitsPerCol);
+			m_current |= (bits - column) << (col * bitsPerCol);
+		}
+	}
+
+	// returns 1 if there is room in column col
+	inline int canPlay( int col ) const
+	{
+		return !(m_mask & topMask( col ));
+	}
+
+	// drop a piece of the player to move into column col, which must have
+	// room; it is then the other player's turn
+	inline void play( int col )
+	{
+		m_current ^= m_mask;
+		m_mask |= m_mask + bottomMask( col );
+	}
+
+	// take back the last move, which was made in column col
+	inline void undo( int col )
+	{
+		m_mask ^= ((m_mask & columnMask( col )) + bottomMask( col )) >> 1;
+		m_current ^= m_mask;
+	}
+
+	// make the move whose square is the single bit move, which must be one
+	// of getPossible()
+	inline void playMove( unsigned long long move )
+	{
+		m_current ^= m_mask;
+		m_mask |= move;
+	}
+
+	// the number of pieces in column col
+	inline int getHeight( int col ) const
+	{
+		return __builtin_popcountll( m_mask & columnMask( col ) );
+	}
+
+	// returns 1 if the player who made the last move has four in a row
+	inline int isWon( void ) const
+	{
+		return isAlignment( m_current ^ m_mask );
+	}
+
+	// the number of pieces on the board
+	inline int getMoves( void ) const
+	{
+		return __builtin_popcountll( m_mask );
+	}
+
+	// A number unique to the position, for the player to move: the pieces of
+	// the player to move, plus the mask, which sets the bit above the top
+	// piece of each column and so tells their pieces from empty squares.
+	inline unsigned long long getKey( void ) const
+	{
+		return m_current + m_mask;
+	}
+
+	// returns 1 if key is the getKey() of a position with no more than six
+	// pieces in a column, and as many pieces of the player to move as of the
+	// other player, or one fewer
+	static inline int isKey( unsigned long long key )
+	{
+		const unsigned long long full = (1ULL << (MAGIC_POSITION_HEIGHT + 1)) - 1;
+		int col;
+
+		if (key & ~(boardMask() | (boardMask() << 1)))
+		{
+			return 0;
+		}
+
+		for (col = 0; col < MAGIC_POSITION_WIDTH; col++)
+		{
+			if (((key >> (col * (MAGIC_POSITION_HEIGHT + 1))) & full) == full)
+			{
+				return 0;
+			}
+		}
+
+		Position position( key );
+		return __builtin_popcountll( position.m_current )
+		       == position.getMoves() / 2;
+	}
+
+	// The key of this position or of its mirror image, whichever is less,
+	// so that a position and its mirror image share one key. fMirrored is
+	// set if it is the mirror image's, in which case anything stored under
+	// the key about a column col is about column 6 - col of this position.
+	inline unsigned long long getCanonicalKey( int &fMirrored ) const
+	{
+		unsigned long long key = getKey();
+		unsigned long long keyMirror = mirror( key );
+
+		fMirrored = keyMirror < key;
+		return fMirrored ? keyMirror : key;
+	}
+
+	// returns 1 if the position is its own mirror image
+	inline int isSymmetric( void ) const
+	{
+		return mirror( m_mask ) == m_mask && mirror( m_current ) == m_current;
+	}
+
+	// the squares a piece could be dropped on now, one per column with room
+	inline unsigned long long getPossible( void ) const
+	{
+		return (m_mask + bottomRowMask()) & boardMask();
+	}
+
+	// the moves with which the player to move would win
+	inline unsigned long long getWinningMoves( void ) const
+	{
+		return winningSquares( m_current, m_mask ) & getPossible();
+	}
+
+	// returns 1 if the player to move can win with this move
+	inline int canWinNext( void ) const
+	{
+		return getWinningMoves() != 0;
+	}
+
+	// The moves that don't let the other player win with their next move,
+	// 0 if every move does. The player to move must not be able to win at
+	// once, as the moves found are only the ones that don't lose.
+	inline unsigned long long getNonLosingMoves( void ) const
+	{
+		unsigned long long possible = getPossible();
+		unsigned long long threats = winningSquares( m_current ^ m_mask,
+		                                             m_mask );
+		unsigned long long forced = possible & threats;
+
+		if (forced)
+		{
+			// two threats to block at once can't both be blocked
+			if (forced & (forced - 1))
+			{
+				return 0;
+			}
+			possible = forced;
+		}
+
+		// don't play just under a square where the other player would win
+		return possible & ~(threats >> 1);
+	}
+
+	// the number of squares the player to move would threaten to win on
+	// after the move move, a good guess at how strong the move is
+	inline int countThreatsAfter( unsigned long long move ) const
+	{
+		return __builtin_popcountll( winningSquares( m_current | move,
+		                                             m_mask ) );
+	}
+
+	// the pieces of the player to move
+	inline unsigned long long getCurrent( void ) const
+	{
+		return m_current;
+	}
+
+	// the pieces of both players
+	inline unsigned long long getMask( void ) const
+	{
+		return m_mask;
+	}
+
+	// returns 1 if the pieces in pos include four in a row in any direction
+	static inline int isAlignment( unsigned long long pos )
+	{
+		unsigned long long m;
+
+		// vertical
+		m = pos & (pos >> 1);
+		if (m & (m >> 2))
+		{
+			return 1;
+		}
+
+		// horizontal
+		m = pos & (pos >> (MAGIC_POSITION_HEIGHT + 1));
+		if (m & (m >> (2 * (MAGIC_POSITION_HEIGHT + 1))))
+		{
+			return 1;
+		}
+
+		// diagonal, rising to the right
+		m = pos & (pos >> (MAGIC_POSITION_HEIGHT + 2));
+		if (m & (m >> (2 * (MAGIC_POSITION_HEIGHT + 2))))
+		{
+			return 1;
+		}
+
+		// diagonal, falling to the right
+		m = pos & (pos >> MAGIC_POSITION_HEIGHT);
+		if (m & (m >> (2 * MAGIC_POSITION_HEIGHT)))
+		{
+			return 1;
+		}
+
+		return 0;
+	}
+
+	// the empty squares (of mask) that would give pos four in a row
+	static inline unsigned long long winningSquares( unsigned long long pos,
+	                                                 unsigned long long mask )
+	{
+		unsigned long long r, p;
+
+		// vertical
+		r = (pos << 1) & (pos << 2) & (pos << 3);
+
+		// horizontal
+		p = (pos << (MAGIC_POSITION_HEIGHT + 1))
+		    & (pos << 2 * (MAGIC_POSITION_HEIGHT + 1));
+		r |= p & (pos << 3 * (MAGIC_POSITION_HEIGHT + 1));
+		r |= p & (pos >> (MAGIC_POSITION_HEIGHT + 1));
+		p = (pos >> (MAGIC_POSITION_HEIGHT + 1))
+		    & (pos >> 2 * (MAGIC_POSITION_HEIGHT + 1));
+		r |= p & (pos << (MAGIC_POSITION_HEIGHT + 1));
+		r |= p & (pos >> 3 * (MAGIC_POSITION_HEIGHT + 1));
+
+		// diagonal, falling to the right
+		p = (pos << MAGIC_POSITION_HEIGHT) & (pos << 2 * MAGIC_POSITION_HEIGHT);
+		r |= p & (pos << 3 * MAGIC_POSITION_HEIGHT);
+		r |= p & (pos >> MAGIC_POSITION_HEIGHT);
+		p = (pos >> MAGIC_POSITION_HEIGHT) & (pos >> 2 * MAGIC_POSITION_HEIGHT);
+		r |= p & (pos << MAGIC_POSITION_HEIGHT);
+		r |= p & (pos >> 3 * MAGIC_POSITION_HEIGHT);
+
+		// diagonal, rising to the right
+		p = (pos << (MAGIC_POSITION_HEIGHT + 2))
+		    & (pos << 2 * (MAGIC_POSITION_HEIGHT + 2));
+		r |= p & (pos << 3 * (MAGIC_POSITION_HEIGHT + 2));
+		r |= p & (pos >> (MAGIC_POSITION_HEIGHT + 2));
+		p = (pos >> (MAGIC_POSITION_HEIGHT + 2))
+		    & (pos >> 2 * (MAGIC_POSITION_HEIGHT + 2));
+		r |= p & (pos << (MAGIC_POSITION_HEIGHT + 2));
+		r |= p & (pos >> 3 * (MAGIC_POSITION_HEIGHT + 2));
+
+		return r & (boardMask() ^ mask);
+	}
+
+	// bits reflected left to right, column 0 swapping with column 6 and so on
+	static inline unsigned long long mirror( unsigned long long bits )
+	{
+		const unsigned long long colMask = (1ULL << (MAGIC_POSITION_HEIGHT + 1)) - 1;
+		const int bitsPerCol = MAGIC_POSITION_HEIGHT + 1;
+
+		return (bits & colMask) << (6 * bitsPerCol)
+		       | (bits & (colMask << bitsPerCol)) << (4 * bitsPerCol)
+		       | (bits & (colMask << (2 * bitsPerCol))) << (2 * bitsPerCol)
+		       | (bits & (colMask << (3 * bitsPerCol)))
+		       | (bits & (colMask << (4 * bitsPerCol))) >> (2 * bitsPerCol)
+		       | (bits & (colMask << (5 * bitsPerCol))) >> (4 * bitsPerCol)
+		       | (bits & (colMask << (6 * bitsPerCol))) >> (6 * bitsPerCol);
+	}
+
+	// the bottom square of every column
+	static inline unsigned long long bottomRowMask( void )
+	{
+		return 0x0000040810204081ULL;
+	}
+
+	// every square of the board
+	static inline unsigned long long boardMask( void )
+	{
+		return bottomRowMask() * ((1ULL << MAGIC_POSITION_HEIGHT) - 1);
+	}
+
+	static inline unsigned long long bottomMask( int col )
+	{
+		return 1ULL << (col * (MAGIC_POSITION_HEIGHT + 1));
+	}
+
+	static inline unsigned long long topMask( int col )
+	{
+		return 1ULL << (MAGIC_POSITION_HEIGHT - 1
+		                + col * (MAGIC_POSITION_HEIGHT + 1));
+	}
+
+	static inline unsigned long long columnMask( int col )
+	{
+		return ((1ULL << MAGIC_POSITION_HEIGHT) - 1)
+		       << (col * (MAGIC_POSITION_HEIGHT + 1));
+	}
+
+private:
+	unsigned long long m_current;   // pieces of the player to move
+	unsigned long long m_mask;      // pieces of both players
+};
+
+#endif // POSITION_H
@@ -0,0 +1,548 @@
+/*
+ * searchpool.cpp: implements the pool of threads shared by all searches
+ *
+ * This file is part of Connect 4 Parallel, which is based on "Drop Four".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ */
+
+/*
+ * Every thread that submits or runs tasks has a slot holding its own deque
+ * of tasks (after Chase and Lev, "Dynamic Circular Work-Stealing Deque").
+ * A thread pushes the tasks it submits onto the bottom of its own deque and
+ * pops them from the bottom again when it runs out of work, so the tasks it
+ * submitted last, the smallest ones, are run first and on a warm cache.  A
+ * thread with an empty deque steals from the top of the other threads'
+ * deques, taking the oldest and so the largest pieces of work.  The owner
+ * only synchronises with thieves when the deque is down to its last task, so
+ * submitting a task is not much more than a store.
+ *
+ * A thread with nothing to do spins for a while, stealing, before going to
+ * sleep on a condition variable.  A task being pushed wakes one sleeper; a
+ * group of tasks finishing wakes all of them, since one of them may be
+ * waiting for that group.  A thread waiting on a group of tasks is no
+ * different from a worker, except that it stops when its group is done.
+ *
+ * The deques are of fixed size.  If a deque is full, submit runs the task at
+ * once, since there is obviously no shortage of work for the other threads.
+ *
+ * Worker threads take a slot for as long as they live.  Any other thread
+ * takes a slot the first time it submits or waits, and gives it back when
+ * the thread exits.  Each slot keeps counts of the tasks its thread has run
+ * and stolen and the time it has spent idle, for tuning how finely the
+ * search is split.
+ *
+ * The pool is started with one thread per online processor the first time
+ * it is used.  setThreads and setPinned stop and restart the workers, so
+ * they must not be called while a search is running.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // for pthread_setaffinity_np
+#endif
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "searchpool.h"
+
+struct SearchTask
+{
+	SearchTaskFn pfn;
+	void* pvArg;
+	SearchGroup* pGroup;
+};
+
+// a thread's deque and counters, kept on cache lines of their own
+struct SearchSlot
+{
+	long iTop;                  // oldest task, taken by thieves
+	char rgPad[ 64 - sizeof( long ) ];
+	long iBottom;               // next free entry, only moved by the owner
+	int fInUse;
+	unsigned long cTasks;
+	unsigned long cSteals;
+	unsigned long long nsIdle;
+	unsigned int seed;          // for picking the first victim to rob
+	SearchTask rgTasks[ MAGIC_LIMIT_POOL_TASKS ];
+} __attribute__(( aligned( 64 ) ));
+
+// times a thread tries to steal, yielding in between, before it sleeps
+const int SearchPool::mconst_spinsMax = 64;
+
+static pthread_mutex_t g_mutex    = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  g_cond     = PTHREAD_COND_INITIALIZER;
+static pthread_once_t  g_onceInit = PTHREAD_ONCE_INIT;
+static pthread_key_t   g_keySlot;
+
+static SearchSlot g_rgSlots[ MAGIC_LIMIT_POOL_SLOTS ];
+static int g_cSlots = 0;     // slots ever handed out, so worth robbing
+
+static __thread SearchSlot* t_pSlot = NULL;
+
+static pthread_t g_rgWorkers[ MAGIC_LIMIT_POOL_THREADS ];
+static int g_cWorkers   = 0;
+static int g_cThreads   = 1; // workers plus the submitting thread
+static int g_fPinned    = 0;
+static int g_fStopping  = 0;
+static int g_cIdle      = 0; // threads looking for work
+static int g_cSleeping  = 0; // threads asleep on g_cond
+
+// start the pool with one thread per online processor
+void SearchPool::init( void )
+{
+	pthread_key_create( &g_keySlot, releaseSlot );
+
+	g_cThreads = clampThreads( (int)sysconf( _SC_NPROCESSORS_ONLN ) );
+	start();
+}
+
+// set the number of threads searching, counting the thread that submits
+// the tasks
+void SearchPool::setThreads( int cThreads )
+{
+	pthread_once( &g_onceInit, init );
+
+	stop();
+	g_cThreads = clampThreads( cThreads );
+	start();
+}
+
+int SearchPool::getThreads( void )
+{
+	pthread_once( &g_onceInit, init );
+	return g_cThreads;
+}
+
+// if fPinned, worker threads are each bound to one processor
+void SearchPool::setPinned( int fPinned )
+{
+	pthread_once( &g_onceInit, init );
+
+	stop();
+	g_fPinned = fPinned ? 1 : 0;
+	start();
+}
+
+int SearchPool::isPinned( void )
+{
+	return g_fPinned;
+}
+
+// clamp a thread count to between 1 and mconst_threadsMax
+int SearchPool::clampThreads( int cThreads )
+{
+	if (cThreads < 1)
+	{
+		cThreads = 1;
+	}
+	else if (cThreads > mconst_threadsMax)
+	{
+		cThreads = mconst_threadsMax;
+	}
+
+	return cThreads;
+}
+
+// push a task onto this thread's deque; it is run by this thread when it
+// waits on group, unless another thread steals it first
+void SearchPool::submit( SearchGroup &group, SearchTaskFn pfn, void* pvArg )
+{
+	SearchSlot* pSlot = getSlot();
+	SearchTask* pTask;
+	long iBottom;
+
+	if (pSlot)
+	{
+		iBottom = pSlot->iBottom;
+		if (iBottom - __atomic_load_n( &pSlot->iTop, __ATOMIC_ACQUIRE )
+		    < MAGIC_LIMIT_POOL_TASKS)
+		{
+			pTask = &pSlot->rgTasks[ iBottom % MAGIC_LIMIT_POOL_TASKS ];
+			pTask->pfn = pfn;
+			pTask->pvArg = pvArg;
+			pTask->pGroup = &group;
+			__atomic_add_fetch( &group.cPending, 1, __ATOMIC_RELAXED );
+			__atomic_store_n( &pSlot->iBottom, iBottom + 1, __ATOMIC_SEQ_CST );
+
+			if (__atomic_load_n( &g_cSleeping, __ATOMIC_SEQ_CST ))
+			{
+				wake( 0 );
+			}
+			return;
+		}
+	}
+
+	// no slot, or a full deque
+	pfn( pvArg );
+}
+
+// returns once every task submitted to group has finished, running tasks
+// (of any group) in the meantime
+void SearchPool::wait( SearchGroup &group )
+{
+	SearchSlot* pSlot = getSlot();
+	SearchTask task;
+
+	while (!isDone( &group ))
+	{
+		if (findTask( pSlot, task ) || idle( pSlot, task, &group ))
+		{
+			runTask( pSlot, task );
+		}
+	}
+}
+
+// Returns the number of threads that are looking for work.  This is read
+// without any lock, so it is only a hint for deciding whether it is worth
+// submitting tasks.
+int SearchPool::getIdle( void )
+{
+	return __atomic_load_n( &g_cIdle, __ATOMIC_RELAXED );
+}
+
+// sum the counters of every slot
+void SearchPool::getStats( SearchStats &stats )
+{
+	int iSlots;
+	unsigned long long nsIdle = 0;
+
+	stats.cTasks = stats.cSteals = 0;
+
+	for (iSlots = 0; iSlots < g_cSlots; iSlots++)
+	{
+		stats.cTasks += g_rgSlots[ iSlots ].cTasks;
+		stats.cSteals += g_rgSlots[ iSlots ].cSteals;
+		nsIdle += g_rgSlots[ iSlots ].nsIdle;
+	}
+
+	stats.secIdle = nsIdle * 1e-9;
+}
+
+// zero the counters; like getStats, this is best called between searches
+void SearchPool::resetStats( void )
+{
+	int iSlots;
+
+	for (iSlots = 0; iSlots < g_cSlots; iSlots++)
+	{
+		g_rgSlots[ iSlots ].cTasks = 0;
+		g_rgSlots[ iSlots ].cSteals = 0;
+		g_rgSlots[ iSlots ].nsIdle = 0;
+	}
+}
+
+// returns the calling thread's slot, giving it one if it has none yet, or
+// NULL if every slot is taken
+SearchSlot* SearchPool::getSlot( void )
+{
+	pthread_once( &g_onceInit, init );
+
+	if (!t_pSlot)
+	{
+		t_pSlot = acquireSlot();
+		if (t_pSlot)
+		{
+			pthread_setspecific( g_keySlot, t_pSlot );
+		}
+	}
+
+	return t_pSlot;
+}
+
+// take a free slot, or return NULL if there is none
+SearchSlot* SearchPool::acquireSlot( void )
+{
+	SearchSlot* pSlot = NULL;
+	int iSlots;
+
+	pthread_mutex_lock( &g_mutex );
+
+	for (iSlots = 0; iSlots < MAGIC_LIMIT_POOL_SLOTS; iSlots++)
+	{
+		if (!g_rgSlots[ iSlots ].fInUse)
+		{
+			pSlot = &g_rgSlots[ iSlots ];
+			pSlot->fInUse = 1;
+			pSlot->seed = iSlots + 1;
+
+			if (iSlots >= g_cSlots)
+			{
+				__atomic_store_n( &g_cSlots, iSlots + 1, __ATOMIC_RELEASE );
+			}
+			break;
+		}
+	}
+
+	pthread_mutex_unlock( &g_mutex );
+
+	return pSlot;
+}
+
+// give back a slot when its thread exits; its deque is empty by then
+void SearchPool::releaseSlot( void* pvSlot )
+{
+	pthread_mutex_lock( &g_mutex );
+	((SearchSlot*)pvSlot)->fInUse = 0;
+	pthread_mutex_unlock( &g_mutex );
+}
+
+// Takes the newest task off this thread's deque or, failing that, steals
+// the oldest task of another thread. Returns 0 if there was no task.
+int SearchPool::findTask( SearchSlot* pSlot, SearchTask &task )
+{
+	SearchSlot* pVictim;
+	long iTop, iBottom;
+	int cSlots, iSlots, iFirst;
+
+	if (pSlot)
+	{
+		iBottom = pSlot->iBottom - 1;
+		__atomic_store_n( &pSlot->iBottom, iBottom, __ATOMIC_SEQ_CST );
+		iTop = __atomic_load_n( &pSlot->iTop, __ATOMIC_SEQ_CST );
+
+		if (iTop < iBottom)
+		{
+			// more than one task left, so no thief can be after this one
+			task = pSlot->rgTasks[ iBottom % MAGIC_LIMIT_POOL_TASKS ];
+			return 1;
+		}
+
+		if (iTop == iBottom)
+		{
+			// the last task: race any thief for it
+			task = pSlot->rgTasks[ iBottom % MAGIC_LIMIT_POOL_TASKS ];
+			if (__atomic_compare_exchange_n( &pSlot->iTop, &iTop, iTop + 1, 0,
+			                                 __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST ))
+			{
+				__atomic_store_n( &pSlot->iBottom, iBottom + 1, __ATOMIC_SEQ_CST );
+				return 1;
+			}
+		}
+
+		// the deque is empty
+		__atomic_store_n( &pSlot->iBottom, iBottom + 1, __ATOMIC_SEQ_CST );
+	}
+
+	cSlots = __atomic_load_n( &g_cSlots, __ATOMIC_ACQUIRE );
+	if (!cSlots)
+	{
+		return 0;
+	}
+
+	// start robbing from a random slot, so thieves don't all pick the same
+	iFirst = pSlot ? rand_r( &pSlot->seed ) % cSlots : 0;
+
+	for (iSlots = 0; iSlots < cSlots; iSlots++)
+	{
+		pVictim = &g_rgSlots[ (iFirst + iSlots) % cSlots ];
+		if (pVictim == pSlot)
+		{
+			continue;
+		}
+
+		iTop = __atomic_load_n( &pVictim->iTop, __ATOMIC_SEQ_CST );
+		iBottom = __atomic_load_n( &pVictim->iBottom, __ATOMIC_SEQ_CST );
+
+		if (iTop < iBottom)
+		{
+			task = pVictim->rgTasks[ iTop % MAGIC_LIMIT_POOL_TASKS ];
+			if (__atomic_compare_exchange_n( &pVictim->iTop, &iTop, iTop + 1, 0,
+			                                 __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST ))
+			{
+				if (pSlot)
+				{
+					pSlot->cSteals++;
+				}
+				return 1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+// run a task, and wake everyone if it was the last of its group
+void SearchPool::runTask( SearchSlot* pSlot, SearchTask &task )
+{
+	task.pfn( task.pvArg );
+
+	if (pSlot)
+	{
+		pSlot->cTasks++;
+	}
+
+	if (!__atomic_sub_fetch( &task.pGroup->cPending, 1, __ATOMIC_SEQ_CST )
+	    && __atomic_load_n( &g_cSleeping, __ATOMIC_SEQ_CST ))
+	{
+		wake( 1 );
+	}
+}
+
+// Looks for a task, spinning and then sleeping, until one turns up or (if
+// pGroup is NULL) the pool is stopped or (if not) pGroup is done. Returns 1
+// if task has been filled in. The time spent is added to the slot's counter.
+int SearchPool::idle( SearchSlot* pSlot, SearchTask &task, SearchGroup* pGroup )
+{
+	struct timespec tsStart, tsEnd;
+	int fFound = 0;
+	int iSpins;
+
+	clock_gettime( CLOCK_MONOTONIC, &tsStart );
+	__atomic_add_fetch( &g_cIdle, 1, __ATOMIC_RELAXED );
+
+	while (!fFound && !isDone( pGroup ))
+	{
+		for (iSpins = 0; iSpins < mconst_spinsMax; iSpins++)
+		{
+			if ((fFound = findTask( pSlot, task )) || isDone( pGroup ))
+			{
+				break;
+			}
+			sched_yield();
+		}
+
+		if (fFound || isDone( pGroup ))
+		{
+			break;
+		}
+
+		// Announce the sleep before the last look for work, so that anyone
+		// who submits or finishes a task after that look will wake us.
+		pthread_mutex_lock( &g_mutex );
+		__atomic_add_fetch( &g_cSleeping, 1, __ATOMIC_SEQ_CST );
+
+		if (!(fFound = findTask( pSlot, task )) && !isDone( pGroup ))
+		{
+			pthread_cond_wait( &g_cond, &g_mutex );
+		}
+
+		__atomic_sub_fetch( &g_cSleeping, 1, __ATOMIC_SEQ_CST );
+		pthread_mutex_unlock( &g_mutex );
+	}
+
+	__atomic_sub_fetch( &g_cIdle, 1, __ATOMIC_RELAXED );
+	clock_gettime( CLOCK_MONOTONIC, &tsEnd );
+
+	if (pSlot)
+	{
+		pSlot->nsIdle += (tsEnd.tv_sec - tsStart.tv_sec) * 1000000000LL
+		                 + (tsEnd.tv_nsec - tsStart.tv_nsec);
+	}
+
+	return fFound;
+}
+
+// for a worker (pGroup NULL), whether the pool is stopping; otherwise,
+// whether every task of pGroup has finished
+int SearchPool::isDone( SearchGroup* pGroup )
+{
+	if (pGroup)
+	{
+		return !__atomic_load_n( &pGroup->cPending, __ATOMIC_SEQ_CST );
+	}
+
+	return __atomic_load_n( &g_fStopping, __ATOMIC_SEQ_CST );
+}
+
+// wake one sleeping thread, or all of them
+void SearchPool::wake( int fAll )
+{
+	pthread_mutex_lock( &g_mutex );
+
+	if (fAll)
+	{
+		pthread_cond_broadcast( &g_cond );
+	}
+	else
+	{
+		pthread_cond_signal( &g_cond );
+	}
+
+	pthread_mutex_unlock( &g_mutex );
+}
+
+// create the worker threads; if one can't be created, the pool is smaller
+void SearchPool::start( void )
+{
+	int iThreads;
+
+	__atomic_store_n( &g_fStopping, 0, __ATOMIC_SEQ_CST );
+
+	for (iThreads = 1; iThreads < g_cThreads; iThreads++)
+	{
+		if (pthread_create( &g_rgWorkers[ g_cWorkers ], NULL, workerThread,
+		                    (void*)(long)iThreads ) == 0)
+		{
+			g_cWorkers++;
+		}
+	}
+
+	g_cThreads = g_cWorkers + 1;
+}
+
+// tell the worker threads to quit, and wait for them
+void SearchPool::stop( void )
+{
+	int iWorkers;
+
+	__atomic_store_n( &g_fStopping, 1, __ATOMIC_SEQ_CST );
+	wake( 1 );
+
+	for (iWorkers = 0; iWorkers < g_cWorkers; iWorkers++)
+	{
+		pthread_join( g_rgWorkers[ iWorkers ], NULL );
+	}
+
+	g_cWorkers = 0;
+}
+
+// bind the calling worker to a processor, leaving processor 0 to whoever
+// submits the tasks
+void SearchPool::pin( int iThread )
+{
+#ifdef __linux__
+	cpu_set_t cpus;
+	int cProcessors = (int)sysconf( _SC_NPROCESSORS_ONLN );
+
+	if (cProcessors > 0)
+	{
+		CPU_ZERO( &cpus );
+		CPU_SET( iThread % cProcessors, &cpus );
+		pthread_setaffinity_np( pthread_self(), sizeof( cpus ), &cpus );
+	}
+#endif
+}
+
+// the body of each worker thread: run tasks until the pool is stopped
+void* SearchPool::workerThread( void* pvThread )
+{
+	SearchSlot* pSlot = getSlot();
+	SearchTask task;
+
+	if (g_fPinned)
+	{
+		pin( (int)(long)pvThread );
+	}
+
+	while (findTask( pSlot, task ) || idle( pSlot, task, NULL ))
+	{
+		runTask( pSlot, task );
+	}
+
+	return NULL;
+}
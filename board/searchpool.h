@@ -0,0 +1,89 @@
+/*
+ * searchpool.h: header file to the pool of threads shared by all searches
+ *
+ * This file is part of Connect 4 Parallel, which is based on "Drop Four".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ */
+
+#ifndef SEARCHPOOL_H
+#define SEARCHPOOL_H
+
+#define MAGIC_LIMIT_POOL_THREADS 64
+#define MAGIC_LIMIT_POOL_SLOTS 128
+#define MAGIC_LIMIT_POOL_TASKS 128
+
+// the function run by a task, passed the task's argument
+typedef void (*SearchTaskFn)( void* pvArg );
+
+// a set of tasks that some thread is waiting on
+struct SearchGroup
+{
+	SearchGroup() : cPending( 0 ) {}
+	int cPending;              // submitted tasks not yet finished
+};
+
+// counters summed over every thread that has used the pool
+struct SearchStats
+{
+	unsigned long cTasks;      // tasks run
+	unsigned long cSteals;     // tasks run by a thread other than the submitter
+	double secIdle;            // total time threads spent looking for work
+};
+
+struct SearchTask;
+struct SearchSlot;
+
+// The search pool is owned by the process rather than by any one Board, so
+// the worker threads are created once and reused by every search.  A thread
+// that submits tasks counts as one of the pool's threads: it runs queued
+// tasks itself while waiting, so a pool of one thread has no workers at all.
+class SearchPool
+{
+public:
+	static void setThreads( int cThreads );
+	static int  getThreads( void );
+	static void setPinned( int fPinned );
+	static int  isPinned( void );
+
+	static void submit( SearchGroup &group, SearchTaskFn pfn, void* pvArg );
+	static void wait( SearchGroup &group );
+	static int  getIdle( void );
+
+	static void getStats( SearchStats &stats );
+	static void resetStats( void );
+
+	static const int mconst_threadsMax = MAGIC_LIMIT_POOL_THREADS;
+
+private:
+	static void  init( void );
+	static int   clampThreads( int cThreads );
+	static void  start( void );
+	static void  stop( void );
+	static void  pin( int iThread );
+	static SearchSlot* getSlot( void );
+	static SearchSlot* acquireSlot( void );
+	static void  releaseSlot( void* pvSlot );
+	static int   findTask( SearchSlot* pSlot, SearchTask &task );
+	static void  runTask( SearchSlot* pSlot, SearchTask &task );
+	static int   idle( SearchSlot* pSlot, SearchTask &task, SearchGroup* pGroup );
+	static int   isDone( SearchGroup* pGroup );
+	static void  wake( int fAll );
+	static void* workerThread( void* pvThread );
+
+	static const int mconst_spinsMax;
+};
+
+#endif // SEARCHPOOL_H
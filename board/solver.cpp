@@ -0,0 +1,458 @@
+/*
+ * solver.cpp: implements the solver, which plays Drop Four perfectly
+ *
+ * This file is part of Connect 4 Parallel, which is based on "Drop Four".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ */
+
+/*
+ * The solver is a negamax search with alpha-beta pruning, like the Board's,
+ * but it searches every move to the end of the game, and so needs none of
+ * the Board's static evaluation.  It works on a Position alone, whose
+ * bitboards make the things it asks at every node cheap: which squares would
+ * win for either player, and so which moves don't hand the other player a
+ * win.  The search follows Pascal Pons' solver ("Solving Connect 4: how to
+ * build a perfect AI"):
+ *
+ * A node never searches a move that lets the other player win at once.  If
+ * the other player threatens to win on a square, that square is the only
+ * move; if there are two such squares, the node is lost.  So the search
+ * never needs to look at a position where the player to move can win.
+ *
+ * The value of a position is known to lie within limits set by the number of
+ * pieces left to play, which narrow the window before anything is searched.
+ *
+ * Moves are searched in the order of the number of squares they threaten to
+ * win on, and then from the centre out.
+ *
+ * solve() doesn't search for the value at once, but asks a series of yes or
+ * no questions ("is the value more than v?"), each a search with a window
+ * of width one, halving the range the value may be in each time.  Narrow
+ * windows prune far more, and each search fills the table for the next.
+ *
+ * The table holds a bound on the value of each position searched: an upper
+ * bound if no move reached alpha, and a lower bound from a move that
+ * reached beta.  A position and its mirror image have the same value, so
+ * they share an entry, under the lesser of their keys (see
+ * Position::getCanonicalKey()).  A key fits in 49 bits, so each entry is one
+ * 64-bit word, the key shifted up by eight bits with the bound below it.
+ * Threads read and write whole words without locks, so they never see half
+ * of an entry, and the whole key is kept, so an entry of another position is
+ * never taken for this one.
+ *
+ * solveMoves() solves the position after each move, the moves being shared
+ * out among the threads of the search pool as the Board's root moves are.
+ * If the position is its own mirror image, only the moves from the centre
+ * to the left are solved.
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+#include "solver.h"
+#include "searchpool.h"
+
+#define MAGIC_LIMIT_SOLVER_POS (MAGIC_POSITION_WIDTH * MAGIC_POSITION_HEIGHT)
+
+// the state shared by the tasks solving the moves of a position
+struct SolveSearch
+{
+	pthread_mutex_t mutex;
+	const Position* pPosition;
+	int iMoveNext;         // index in mconst_rgColOrder of the next move
+	int best;              // the best value so far
+	int fSymmetric;        // 1 if the moves right of centre needn't be solved
+	int* rgScores;
+};
+
+const int Solver::mconst_scoreNil = -1000;
+
+// No value, nor any alpha that negamax() stores, is further from 0 than
+// these, the values of a loss or a win with every piece still to play.  The
+// table stores an upper bound v as v - mconst_scoreMin + 1 and a lower bound
+// above all of those, so that an entry with a bound of 0 is an empty one.
+const int Solver::mconst_scoreMin = -MAGIC_LIMIT_SOLVER_POS / 2;
+const int Solver::mconst_scoreMax = (MAGIC_LIMIT_SOLVER_POS + 1) / 2;
+
+// the moves from the centre out, which is the order to try them in
+const int Solver::mconst_rgColOrder[] = { 3, 2, 4, 1, 5, 0, 6 };
+
+static pthread_once_t g_onceInit = PTHREAD_ONCE_INIT;
+static unsigned long long* g_rgEntries = NULL;
+static int g_cBits = 0;
+
+void Solver::init( void )
+{
+	if (!g_rgEntries)
+	{
+		setSize( MAGIC_DEFAULT_SOLVER_BITS );
+	}
+}
+
+// Sets the table to 2^cBits entries (8 bytes each), emptying it. If the
+// memory can't be had, the table is left as it was. Not to be called while
+// a search is running.
+void Solver::setSize( int cBits )
+{
+	unsigned long long* rgEntries;
+
+	if (cBits < 1 || cBits > 32)
+	{
+		cBits = MAGIC_DEFAULT_SOLVER_BITS;
+	}
+
+	rgEntries = (unsigned long long*)calloc( (size_t)1 << cBits,
+	                                         sizeof( unsigned long long ) );
+	if (rgEntries)
+	{
+		free( g_rgEntries );
+		g_rgEntries = rgEntries;
+		g_cBits = cBits;
+	}
+}
+
+// returns log2 of the number of entries
+int Solver::getSize( void )
+{
+	pthread_once( &g_onceInit, init );
+	return g_cBits;
+}
+
+// empty the table; not to be called while a search is running
+void Solver::clear( void )
+{
+	size_t iEntries;
+
+	pthread_once( &g_onceInit, init );
+
+	for (iEntries = 0; iEntries < (size_t)1 << g_cBits; iEntries++)
+	{
+		g_rgEntries[ iEntries ] = 0;
+	}
+}
+
+// the entry of the table for the position of key
+static inline unsigned long long* getEntry( unsigned long long key )
+{
+	// the low bits of a key are the bottom of the first columns, so mix
+	// the bits before taking the top ones
+	return &g_rgEntries[ (key * 0x9e3779b97f4a7c15ULL) >> (64 - g_cBits) ];
+}
+
+// returns the value of the position to the player to move
+int Solver::solve( const Position &position )
+{
+	pthread_once( &g_onceInit, init );
+	return solveWindow( position, mconst_scoreNil, -mconst_scoreNil );
+}
+
+// Returns the value of the position to the player to move if it is within
+// the window alpha to beta, and otherwise alpha if the value is no more
+// than alpha, or beta if it is at least beta.
+int Solver::solveWindow( const Position &position, int alpha, int beta )
+{
+	int cMoves = position.getMoves();
+	int min, max, med, score;
+
+	if (position.canWinNext())
+	{
+		score = (MAGIC_LIMIT_SOLVER_POS + 1 - cMoves) / 2;
+		return (score < beta) ? score : beta;
+	}
+
+	min = -(MAGIC_LIMIT_SOLVER_POS - cMoves) / 2;
+	max = (MAGIC_LIMIT_SOLVER_POS + 1 - cMoves) / 2;
+	min = (min > alpha) ? min : alpha;
+	max = (max < beta) ? max : beta;
+
+	while (min < max)
+	{
+		// Halve the range, but ask about values nearer 0 first, where
+		// the answer is quickest found.
+		med = min + (max - min) / 2;
+		if (med <= 0 && min / 2 < med)
+		{
+			med = min / 2;
+		}
+		else if (med >= 0 && max / 2 > med)
+		{
+			med = max / 2;
+		}
+
+		score = negamax( position, med, med + 1 );
+		if (score <= med)
+		{
+			max = score;
+		}
+		else
+		{
+			min = score;
+		}
+	}
+
+	return min;
+}
+
+// Fills in the value of each move to the player to move, or mconst_scoreNil
+// for a full column, and returns the best move, from the centre out if
+// several are as good. The moves are solved by the threads of the search
+// pool. Only the values of the best moves are exact: a move found to be
+// worse than one already solved is only known to be worse, and its score
+// is a bound somewhere below the best.
+int Solver::solveMoves( const Position &position,
+                        int rgScores[ MAGIC_POSITION_WIDTH ] )
+{
+	SolveSearch search;
+	SearchGroup group;
+	int cTasks = SearchPool::getThreads();
+	int iTasks;
+	int iMoves, col;
+	int colBest;
+
+	pthread_once( &g_onceInit, init );
+
+	pthread_mutex_init( &search.mutex, NULL );
+	search.pPosition = &position;
+	search.iMoveNext = 0;
+	search.rgScores = rgScores;
+	search.best = mconst_scoreNil;
+	search.fSymmetric = position.isSymmetric();
+
+	// more tasks than moves would have nothing to do
+	if (cTasks > MAGIC_POSITION_WIDTH)
+	{
+		cTasks = MAGIC_POSITION_WIDTH;
+	}
+
+	for (iTasks = 1; iTasks < cTasks; iTasks++)
+	{
+		SearchPool::submit( group, solveMovesTask, &search );
+	}
+
+	solveMovesTask( &search );
+	SearchPool::wait( group );
+
+	pthread_mutex_destroy( &search.mutex );
+
+	if (search.fSymmetric)
+	{
+		for (col = 0; col < MAGIC_POSITION_WIDTH / 2; col++)
+		{
+			rgScores[ MAGIC_POSITION_WIDTH - 1 - col ] = rgScores[ col ];
+		}
+	}
+
+	colBest = mconst_rgColOrder[ 0 ];
+	for (iMoves = 0; iMoves < MAGIC_POSITION_WIDTH; iMoves++)
+	{
+		col = mconst_rgColOrder[ iMoves ];
+		if (rgScores[ col ] > rgScores[ colBest ])
+		{
+			colBest = col;
+		}
+	}
+
+	return colBest;
+}
+
+// the body of each task solving moves
+void Solver::solveMovesTask( void* pvSearch )
+{
+	SolveSearch* pSearch = (SolveSearch*)pvSearch;
+	const Position &position = *pSearch->pPosition;
+	unsigned long long winning;
+	int iMoves;
+	int col;
+	int best, score;
+
+	winning = Position::winningSquares( position.getCurrent(),
+	                                    position.getMask() )
+	          & position.getPossible();
+
+	for (;;)
+	{
+		pthread_mutex_lock( &pSearch->mutex );
+		iMoves = pSearch->iMoveNext++;
+		best = pSearch->best;
+		pthread_mutex_unlock( &pSearch->mutex );
+
+		if (iMoves >= MAGIC_POSITION_WIDTH)
+		{
+			break;
+		}
+
+		col = mconst_rgColOrder[ iMoves ];
+
+		// solveMoves() copies the score of the mirror image
+		if (pSearch->fSymmetric && col > MAGIC_POSITION_WIDTH / 2)
+		{
+			continue;
+		}
+
+		if (!position.canPlay( col ))
+		{
+			pSearch->rgScores[ col ] = mconst_scoreNil;
+			continue;
+		}
+
+		if (winning & Position::columnMask( col ))
+		{
+			score = (MAGIC_LIMIT_SOLVER_POS + 1 - position.getMoves()) / 2;
+		}
+		else
+		{
+			Position daughter( position );
+
+			// only a move at least as good as the best so far needs its
+			// value, so that ties are settled by the order of the moves
+			daughter.play( col );
+			score = -solveWindow( daughter, mconst_scoreNil, -best + 1 );
+		}
+
+		pSearch->rgScores[ col ] = score;
+
+		pthread_mutex_lock( &pSearch->mutex );
+		if (score > pSearch->best)
+		{
+			pSearch->best = score;
+		}
+		pthread_mutex_unlock( &pSearch->mutex );
+	}
+}
+
+// Returns the value of the position to the player to move, which must not
+// be able to win with this move, if it is within the window alpha to beta.
+// Otherwise returns a bound: at most alpha or at least beta.
+int Solver::negamax( const Position &position, int alpha, int beta )
+{
+	unsigned long long next = position.getNonLosingMoves();
+	unsigned long long* pEntry;
+	unsigned long long key, entry, move;
+	unsigned long long rgMoves[ MAGIC_POSITION_WIDTH ];
+	int rgThreats[ MAGIC_POSITION_WIDTH ];
+	int cMoves = position.getMoves();
+	int movesLim = 0;
+	int iMoves, j;
+	int min, max, bound, threats, score;
+	int fMirrored;
+
+	// every move lets the other player win
+	if (!next)
+	{
+		return -(MAGIC_LIMIT_SOLVER_POS - cMoves) / 2;
+	}
+
+	// neither player can win with the last two pieces
+	if (cMoves >= MAGIC_LIMIT_SOLVER_POS - 2)
+	{
+		return 0;
+	}
+
+	// the other player can't win with the next piece
+	min = -(MAGIC_LIMIT_SOLVER_POS - 2 - cMoves) / 2;
+	if (alpha < min)
+	{
+		alpha = min;
+		if (alpha >= beta)
+		{
+			return alpha;
+		}
+	}
+
+	// the player to move can't win with this piece
+	max = (MAGIC_LIMIT_SOLVER_POS - 1 - cMoves) / 2;
+
+	key = position.getCanonicalKey( fMirrored );
+	pEntry = getEntry( key );
+	entry = __atomic_load_n( pEntry, __ATOMIC_RELAXED );
+	bound = (int)(entry & 0xff);
+	if (entry >> 8 == key && bound)
+	{
+		if (bound > mconst_scoreMax - mconst_scoreMin + 1)
+		{
+			min = bound + 2 * mconst_scoreMin - mconst_scoreMax - 2;
+			if (alpha < min)
+			{
+				alpha = min;
+				if (alpha >= beta)
+				{
+					return alpha;
+				}
+			}
+		}
+		else if (max > bound + mconst_scoreMin - 1)
+		{
+			max = bound + mconst_scoreMin - 1;
+		}
+	}
+
+	if (beta > max)
+	{
+		beta = max;
+		if (alpha >= beta)
+		{
+			return beta;
+		}
+	}
+
+	// insertion sort on the threats each move makes, ties from the centre out
+	for (iMoves = 0; iMoves < MAGIC_POSITION_WIDTH; iMoves++)
+	{
+		move = next & Position::columnMask( mconst_rgColOrder[ iMoves ] );
+		if (!move)
+		{
+			continue;
+		}
+
+		threats = position.countThreatsAfter( move );
+		for (j = movesLim; j > 0 && rgThreats[ j - 1 ] < threats; j--)
+		{
+			rgMoves[ j ] = rgMoves[ j - 1 ];
+			rgThreats[ j ] = rgThreats[ j - 1 ];
+		}
+		rgMoves[ j ] = move;
+		rgThreats[ j ] = threats;
+		movesLim++;
+	}
+
+	for (iMoves = 0; iMoves < movesLim; iMoves++)
+	{
+		Position daughter( position );
+
+		daughter.playMove( rgMoves[ iMoves ] );
+		score = -negamax( daughter, -beta, -alpha );
+
+		if (score >= beta)
+		{
+			// a lower bound, stored above the upper bounds
+			__atomic_store_n( pEntry, key << 8
+			                  | (unsigned long long)(score + mconst_scoreMax
+			                                         - 2 * mconst_scoreMin + 2),
+			                  __ATOMIC_RELAXED );
+			return score;
+		}
+
+		if (score > alpha)
+		{
+			alpha = score;
+		}
+	}
+
+	// an upper bound
+	__atomic_store_n( pEntry, key << 8
+	                  | (unsigned long long)(alpha - mconst_scoreMin + 1),
+	                  __ATOMIC_RELAXED );
+	return alpha;
+}
@@ -0,0 +1,60 @@
+/*
+ * solver.h: header file to the solver, which plays Drop Four perfectly
+ *
+ * This file is part of Connect 4 Parallel, which is based on "Drop Four".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ */
+
+#ifndef SOLVER_H
+#define SOLVER_H
+
+#include "position.h"
+
+#define MAGIC_DEFAULT_SOLVER_BITS 23
+
+// The solver finds the value of a position with perfect play by both sides,
+// searching to the end of the game.  A value is to the player to move: 0 for
+// a draw, positive for a win and negative for a loss, and the sooner the win
+// the larger, as it is 22 less the number of pieces the winner will have
+// played by the end of the game (so 1 is a win with the very last piece).
+//
+// Like the transposition table, the solver's table of results is owned by
+// the process and shared by every thread; see the .cpp.
+class Solver
+{
+public:
+	static void setSize( int cBits );
+	static int  getSize( void );
+	static void clear( void );
+
+	static int  solve( const Position &position );
+	static int  solveMoves( const Position &position,
+	                        int rgScores[ MAGIC_POSITION_WIDTH ] );
+
+	static const int mconst_scoreNil;  // in place of the score of a full column
+
+private:
+	static void init( void );
+	static int  solveWindow( const Position &position, int alpha, int beta );
+	static int  negamax( const Position &position, int alpha, int beta );
+	static void solveMovesTask( void* pvSearch );
+
+	static const int mconst_scoreMin;
+	static const int mconst_scoreMax;
+	static const int mconst_rgColOrder[ MAGIC_POSITION_WIDTH ];
+};
+
+#endif // SOLVER_H
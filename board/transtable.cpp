@@ -0,0 +1,193 @@
+/*
+ * transtable.cpp: implements the transposition table shared by searches
+ *
+ * This file is part of Connect 4 Parallel, which is based on "Drop Four".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ */
+
+/*
+ * The table is an array of 2^cBits slots, each of two 64-bit words, indexed
+ * by the low bits of a position's Zobrist key (see board.cpp).  The second
+ * word packs what is known about the position:
+ *
+ *   bits  0-15  the static evaluation, offset by 32768
+ *   bits 16-23  depth
+ *   bits 24-25  bound
+ *   bits 26-28  column of the best move, 7 if none
+ *   bits 32-39  the search that stored it (for replacement)
+ *   bits 40-43  the settings it was searched with
+ *
+ * The first word is the key XORed with the second.  Threads read and write
+ * the two words without any lock, so a slot may be read halfway through
+ * another thread's write to it, giving one word of the old entry and one of
+ * the new.  XORing the words back together then doesn't give the key, and
+ * the slot is treated as empty (after Hyatt and Mann, "A lock-less
+ * transposition table implementation for parallel search chess engines").
+ *
+ * The value found for a position depends on how it was searched (the depth,
+ * branching factor and reductions of a difficulty), so the caller gives the
+ * settings it searches with, which are stored with the entry, and an entry
+ * stored with other settings is not found: otherwise a deep search at one
+ * difficulty would end the searches at another early, when two boards share
+ * the process.
+ *
+ * Each search is given its own number by newSearch(), stored with every
+ * entry it makes.  A slot is overwritten by a search of the same position,
+ * by a deeper search, or by any search once the entry it holds is from
+ * another one, such as the search of an earlier turn.  Two searches running
+ * at once each keep their own entries, and neither ages the other's.
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+#include "transtable.h"
+
+struct TransSlot
+{
+	unsigned long long keyXorData;
+	unsigned long long data;
+};
+
+static pthread_once_t g_onceInit = PTHREAD_ONCE_INIT;
+static TransSlot* g_rgSlots = NULL;
+static int g_cBits = 0;
+static unsigned long long g_mask = 0;
+static unsigned int g_generation = 0;
+
+void TransTable::init( void )
+{
+	if (!g_rgSlots)
+	{
+		setSize( MAGIC_DEFAULT_TRANS_BITS );
+	}
+}
+
+// Sets the table to 2^cBits slots (16 bytes each), emptying it. If the
+// memory can't be had, the table is left as it was. Not to be called while
+// a search is running.
+void TransTable::setSize( int cBits )
+{
+	TransSlot* rgSlots;
+
+	if (cBits < 1 || cBits > 32)
+	{
+		cBits = MAGIC_DEFAULT_TRANS_BITS;
+	}
+
+	rgSlots = (TransSlot*)calloc( (size_t)1 << cBits, sizeof( TransSlot ) );
+	if (rgSlots)
+	{
+		free( g_rgSlots );
+		g_rgSlots = rgSlots;
+		g_cBits = cBits;
+		g_mask = ((unsigned long long)1 << cBits) - 1;
+	}
+}
+
+// returns log2 of the number of slots
+int TransTable::getSize( void )
+{
+	pthread_once( &g_onceInit, init );
+	return g_cBits;
+}
+
+// empty the table; not to be called while a search is running
+void TransTable::clear( void )
+{
+	unsigned long long iSlots;
+
+	pthread_once( &g_onceInit, init );
+
+	for (iSlots = 0; iSlots <= g_mask; iSlots++)
+	{
+		g_rgSlots[ iSlots ].keyXorData = 0;
+		g_rgSlots[ iSlots ].data = 0;
+	}
+}
+
+// called at the start of each search, returning the number to store its
+// entries under, so that they may replace whatever other searches left
+int TransTable::newSearch( void )
+{
+	pthread_once( &g_onceInit, init );
+	return (int)(__atomic_add_fetch( &g_generation, 1, __ATOMIC_RELAXED ) & 0xff);
+}
+
+// returns 1 and fills in entry if the table knows the position of key, as
+// searched with settings (0 to 15)
+int TransTable::probe( unsigned long long key, int settings,
+                       TransEntry &entry )
+{
+	TransSlot* pSlot;
+	unsigned long long keyXorData, data;
+	int colMove;
+
+	pthread_once( &g_onceInit, init );
+
+	pSlot = &g_rgSlots[ key & g_mask ];
+	keyXorData = __atomic_load_n( &pSlot->keyXorData, __ATOMIC_RELAXED );
+	data = __atomic_load_n( &pSlot->data, __ATOMIC_RELAXED );
+
+	if ((keyXorData ^ data) != key || !data
+	    || (int)((data >> 40) & 0xf) != settings)
+	{
+		return 0;
+	}
+
+	colMove = (int)((data >> 26) & 7);
+
+	entry.eval = (int)(data & 0xffff) - 32768;
+	entry.depth = (int)((data >> 16) & 0xff);
+	entry.bound = (int)((data >> 24) & 3);
+	entry.colMove = (colMove == 7) ? -1 : colMove;
+
+	return 1;
+}
+
+// record what the search generation, from newSearch(), found out about the
+// position of key, searching with settings (0 to 15)
+void TransTable::store( unsigned long long key, int settings, int generation,
+                        int depth, int bound, int eval, int colMove )
+{
+	TransSlot* pSlot;
+	unsigned long long keyXorData, data, dataOld;
+
+	pthread_once( &g_onceInit, init );
+
+	pSlot = &g_rgSlots[ key & g_mask ];
+	keyXorData = __atomic_load_n( &pSlot->keyXorData, __ATOMIC_RELAXED );
+	dataOld = __atomic_load_n( &pSlot->data, __ATOMIC_RELAXED );
+
+	// keep a deeper search of another position, or with other settings, by
+	// this search
+	if (((keyXorData ^ dataOld) != key
+	     || (int)((dataOld >> 40) & 0xf) != settings)
+	    && (int)((dataOld >> 32) & 0xff) == generation
+	    && (int)((dataOld >> 16) & 0xff) > depth)
+	{
+		return;
+	}
+
+	data = (unsigned long long)(eval + 32768)
+	       | (unsigned long long)(depth & 0xff) << 16
+	       | (unsigned long long)bound << 24
+	       | (unsigned long long)(colMove < 0 ? 7 : colMove) << 26
+	       | (unsigned long long)(generation & 0xff) << 32
+	       | (unsigned long long)(settings & 0xf) << 40;
+
+	__atomic_store_n( &pSlot->keyXorData, key ^ data, __ATOMIC_RELAXED );
+	__atomic_store_n( &pSlot->data, data, __ATOMIC_RELAXED );
+}
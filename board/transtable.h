@@ -0,0 +1,58 @@
+/*
+ * transtable.h: header file to the transposition table shared by searches
+ *
+ * This file is part of Connect 4 Parallel, which is based on "Drop Four".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ */
+
+#ifndef TRANSTABLE_H
+#define TRANSTABLE_H
+
+#define MAGIC_DEFAULT_TRANS_BITS 20
+
+// what a search of a position found out
+struct TransEntry
+{
+	int depth;                 // plies searched below the position
+	int bound;                 // one of the TransTable::mconst_bound* values
+	int eval;
+	int colMove;               // best column, or -1 if not known
+};
+
+// The transposition table is owned by the process, like the search pool, and
+// is shared by every thread of every search.  It needs no locks; see the .cpp.
+class TransTable
+{
+public:
+	static void setSize( int cBits );
+	static int  getSize( void );
+	static void clear( void );
+	static int  newSearch( void );
+
+	static int  probe( unsigned long long key, int settings,
+	                   TransEntry &entry );
+	static void store( unsigned long long key, int settings, int generation,
+	                   int depth, int bound, int eval, int colMove );
+
+	static const int mconst_boundExact = 0; // eval is the value
+	static const int mconst_boundLower = 1; // the value is at least eval
+	static const int mconst_boundUpper = 2; // the value is at most eval
+
+private:
+	static void init( void );
+};
+
+#endif // TRANSTABLE_H
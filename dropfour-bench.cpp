@@ -0,0 +1,431 @@
+/*
+ * dropfour-bench.cpp: times the computer's search on a fixed set of positions
+ *
+ * This file is part of Connect 4 Parallel, which is based on "Drop Four".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ */
+
+/*
+ * Usage: drop4bench [-d difficulty] [-t threads] [-m] [-a] [-c] [-u] [-n]
+ *
+ * Plays the computer's move in each of the benchmark positions, from an
+ * empty transposition table, and prints the move, the interior nodes
+ * searched and the time taken, then the totals.  The difficulty defaults to
+ * 9, at which the computer always plays the best move it finds, so that two
+ * versions of the search can be compared move for move.  The positions are
+ * from the openings and middles of games the computer played against
+ * itself, and from games with random openings chosen because few moves
+ * keep their value, given as the columns played so far.  With -m, the root
+ * is searched by MTD(f) instead of alpha-beta (see Board::setDriver()), so
+ * that the two can be compared on the same positions.  The first line
+ * also says whether the search was built to copy the board for each
+ * daughter or to make and take back the moves (see MAGIC_COPY_MAKE in
+ * board/board.h), so that two builds can be compared in the same way.
+ *
+ * With -a, the tactical accuracy of the moves is measured as well: each
+ * position with at least MAGIC_BENCH_SOLVE_MOVES_MIN pieces is solved
+ * (see board/solver.cpp), and the perfect value of the move played is
+ * printed after the best perfect value.  The totals count the moves as good
+ * as the best, and the moves that at least keep the win, draw or loss that
+ * the best move would.
+ *
+ * With -c, nothing is searched: instead the time taken to copy the board
+ * is measured, as a task does to help search a position on another thread,
+ * copying each position's board MAGIC_BENCH_COPIES times.  With -u, the
+ * time taken to make a move and take it back is measured instead: in each
+ * position, each column with room is played and taken back in turn,
+ * MAGIC_BENCH_COPIES times in all.
+ *
+ * With -n, the calls to malloc(), calloc() and realloc() made while the
+ * computer is choosing its moves are counted too (which is why this file
+ * defines them), and drop4bench fails if there are any: once the pool and
+ * the transposition table have been set up by a first move, searching
+ * should take nothing from the heap on any thread.  make check runs it.
+ */
+
+#include <iostream>
+#include <iomanip>
+using namespace std;
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "board/board.h"
+#include "board/searchpool.h"
+#include "board/transtable.h"
+#include "board/solver.h"
+
+// solving positions with fewer pieces than this takes too long
+#define MAGIC_BENCH_SOLVE_MOVES_MIN 8
+
+// copies of each position's board timed with -c
+#define MAGIC_BENCH_COPIES 1000000
+
+// While g_fCountAllocs is set, every allocation from the heap, by any
+// thread, is counted in g_cAllocs before being passed on to glibc's own.
+// operator new and the rest of the library allocate through these as well.
+extern "C" void* __libc_malloc( size_t cb );
+extern "C" void* __libc_calloc( size_t c, size_t cb );
+extern "C" void* __libc_realloc( void* pv, size_t cb );
+
+static int g_fCountAllocs = 0;
+static long g_cAllocs = 0;
+
+static inline void countAlloc( void )
+{
+	if (__atomic_load_n( &g_fCountAllocs, __ATOMIC_RELAXED ))
+	{
+		__atomic_add_fetch( &g_cAllocs, 1, __ATOMIC_RELAXED );
+	}
+}
+
+extern "C" void* malloc( size_t cb )
+{
+	countAlloc();
+	return __libc_malloc( cb );
+}
+
+extern "C" void* calloc( size_t c, size_t cb )
+{
+	countAlloc();
+	return __libc_calloc( c, cb );
+}
+
+extern "C" void* realloc( void* pv, size_t cb )
+{
+	countAlloc();
+	return __libc_realloc( pv, cb );
+}
+
+static const char* g_rgszPositions[] = {
+	"",
+	"333",
+	"333331",
+	"333331562",
+	"333331562444",
+	"333331562444545",
+	"333331562444545541",
+	"333331562444545541020",
+	"333331111",
+	"333331111315",
+	"333331111315555",
+	"333331111315555551",
+	"333331111315555551622",
+	"333334",
+	"333334434",
+	"333334434445",
+	"333334434445411",
+	"333334434445411111",
+	"333334434445411111616",
+	"333333",
+	"333333122",
+	"333333122226",
+	"333333122226112",
+	"333333122226112141",
+	"333333122226112141146",
+	"332",
+	"324",
+	"324251",
+	"32422333",
+	"324223334244",
+	"234",
+	"234561",
+	"23453334",
+	"234533344456",
+	"443",
+	"32323322",
+	"323233223246",
+
+	// positions from games with random openings in which only one or two
+	// moves keep the win or the draw, to test the search's tactics
+	"60353335551",
+	"1150133511334",
+	"10544441555161146602",
+	"2324223563453554",
+	"262152343444231132331",
+	"00360333313111004",
+	"163233311132122236",
+	"54061444233331532",
+	"466544544165",
+	"1550444264551141211",
+	"00644422242441221103",
+	"360412232331223114",
+	"41213531133444222",
+	"465432423224",
+	"5065344554",
+	"56003233330636",
+	"3415203342342",
+	"04331211122244442240",
+	"02102223552001113",
+	"001222234333452311302",
+	"562122343444233325",
+	"4651323324324311",
+	"0045444335545",
+	"45014445655451110",
+};
+
+// returns -1, 0 or 1 for a loss, draw or win with the value score
+static int outcome( int score )
+{
+	return (score > 0) - (score < 0);
+}
+
+// Returns the perfect value of the move col, which must have room, to the
+// player to move in position: that of the win if the move wins at once, and
+// otherwise the value of the position after it, solved exactly.  The values
+// Solver::solveMoves() gives the moves worse than the best are only bounds.
+static int solveMove( const Position &position, int col )
+{
+	Position daughter( position );
+
+	if (position.getWinningMoves() & Position::columnMask( col ))
+	{
+		return (MAGIC_POSITION_WIDTH * MAGIC_POSITION_HEIGHT + 1
+		        - position.getMoves()) / 2;
+	}
+
+	daughter.play( col );
+	return -Solver::solve( daughter );
+}
+
+// returns the CLOCK_MONOTONIC time in seconds
+static double secNow( void )
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Returns the seconds taken to copy board MAGIC_BENCH_COPIES times, each
+// copy made as a search task makes it and then read, so that none of them
+// can be left out.
+static double secCopies( const Board &board )
+{
+	double secStart = secNow();
+	int iCopies;
+
+	for (iCopies = 0; iCopies < MAGIC_BENCH_COPIES; iCopies++)
+	{
+		Board copy( board );
+		__asm__ __volatile__( "" : : "r"( &copy ) : "memory" );
+	}
+
+	return secNow() - secStart;
+}
+
+// Returns the seconds taken to make MAGIC_BENCH_COPIES moves in board and
+// take them back, each column with room in turn.
+static double secMoves( Board &board )
+{
+	double secStart;
+	int rgMoves[ MAGIC_POSITION_WIDTH ];
+	int movesLim = 0;
+	int iCopies;
+	int col;
+
+	for (col = 0; col < MAGIC_POSITION_WIDTH; col++)
+	{
+		if (board.takeHumanTurn( col ) != Board::mconst_colNil)
+		{
+			board.takeBackMove();
+			rgMoves[ movesLim++ ] = col;
+		}
+	}
+
+	secStart = secNow();
+	for (iCopies = 0; iCopies < MAGIC_BENCH_COPIES; iCopies++)
+	{
+		board.takeHumanTurn( rgMoves[ iCopies % movesLim ] );
+		board.takeBackMove();
+	}
+
+	return secNow() - secStart;
+}
+
+int main( int argc, char** argv )
+{
+	int difficulty = 9;
+	int driver = Board::mconst_driverAlphaBeta;
+	int cPositions = sizeof( g_rgszPositions ) / sizeof( g_rgszPositions[ 0 ] );
+	int iPositions;
+	int opt;
+	const char* pch;
+	unsigned long long cNodes, cNodesTotal = 0;
+	double secStart, sec, secTotal = 0;
+	int colMove;
+	int fAccuracy = 0;
+	int fCopies = 0;
+	int fMoves = 0;
+	int fAllocs = 0;
+	Position position;
+	int rgScores[ MAGIC_POSITION_WIDTH ];
+	int colBest;
+	int score;
+	int cSolved = 0, cBest = 0, cOutcome = 0;
+
+	while ((opt = getopt( argc, argv, "d:t:macun" )) != -1)
+	{
+		switch (opt)
+		{
+		case 'd':
+			difficulty = atoi( optarg );
+			break;
+		case 't':
+			SearchPool::setThreads( atoi( optarg ) );
+			break;
+		case 'm':
+			driver = Board::mconst_driverMtdf;
+			break;
+		case 'a':
+			fAccuracy = 1;
+			break;
+		case 'c':
+			fCopies = 1;
+			break;
+		case 'u':
+			fMoves = 1;
+			break;
+		case 'n':
+			fAllocs = 1;
+			break;
+		default:
+			cerr << "usage: drop4bench [-d difficulty] [-t threads] [-m] [-a] [-c]"
+			        " [-u] [-n]" << endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (fCopies || fMoves)
+	{
+		if (fCopies)
+		{
+			cout << "copies of a board of " << sizeof( Board ) << " bytes"
+			     << endl;
+		}
+		else
+		{
+			cout << "moves made and taken back" << endl;
+		}
+
+		for (iPositions = 0; iPositions < cPositions; iPositions++)
+		{
+			Board board;
+
+			for (pch = g_rgszPositions[ iPositions ]; *pch; pch++)
+			{
+				board.takeHumanTurn( *pch - '0' );
+			}
+
+			sec = fCopies ? secCopies( board ) : secMoves( board );
+			cout << setw( 22 ) << left << g_rgszPositions[ iPositions ] << right
+			     << setw( 10 ) << fixed << setprecision( 1 )
+			     << sec * 1e9 / MAGIC_BENCH_COPIES << endl;
+			secTotal += sec;
+		}
+
+		cout << "total " << (long long)cPositions * MAGIC_BENCH_COPIES
+		     << (fCopies ? " copies in " : " moves in ")
+		     << setprecision( 3 ) << secTotal << " seconds, "
+		     << setprecision( 1 )
+		     << secTotal * 1e9 / ((double)cPositions * MAGIC_BENCH_COPIES)
+		     << (fCopies ? " ns/copy" : " ns/move") << endl;
+
+		return EXIT_SUCCESS;
+	}
+
+	cout << "difficulty " << difficulty << ", "
+	     << SearchPool::getThreads() << " threads, "
+	     << (driver == Board::mconst_driverMtdf ? "MTD(f)" : "alpha-beta")
+	     << (MAGIC_COPY_MAKE ? ", copy-make" : ", make/unmake") << endl;
+
+	if (fAllocs)
+	{
+		// start the pool and make the table, which are allowed to allocate
+		Board board;
+
+		board.setDifficulty( difficulty );
+		board.takeComputerTurn();
+	}
+
+	for (iPositions = 0; iPositions < cPositions; iPositions++)
+	{
+		Board board;
+
+		board.setDifficulty( difficulty );
+		board.setDriver( driver );
+		position = Position();
+		for (pch = g_rgszPositions[ iPositions ]; *pch; pch++)
+		{
+			board.takeHumanTurn( *pch - '0' );
+			position.play( *pch - '0' );
+		}
+
+		TransTable::clear();
+
+		__atomic_store_n( &g_fCountAllocs, fAllocs, __ATOMIC_SEQ_CST );
+		secStart = secNow();
+		colMove = board.takeComputerTurn();
+		sec = secNow() - secStart;
+		__atomic_store_n( &g_fCountAllocs, 0, __ATOMIC_SEQ_CST );
+		cNodes = board.getNodes();
+
+		cout << setw( 22 ) << left << g_rgszPositions[ iPositions ] << right
+		     << setw( 3 ) << colMove
+		     << setw( 12 ) << cNodes
+		     << setw( 10 ) << fixed << setprecision( 3 ) << sec;
+
+		if (fAccuracy && position.getMoves() >= MAGIC_BENCH_SOLVE_MOVES_MIN)
+		{
+			colBest = Solver::solveMoves( position, rgScores );
+			score = solveMove( position, colMove );
+			cout << setw( 5 ) << rgScores[ colBest ]
+			     << setw( 5 ) << score;
+
+			cSolved++;
+			cBest += score == rgScores[ colBest ];
+			cOutcome += outcome( score ) == outcome( rgScores[ colBest ] );
+		}
+
+		cout << endl;
+
+		cNodesTotal += cNodes;
+		secTotal += sec;
+	}
+
+	cout << "total " << cNodesTotal << " nodes in " << fixed
+	     << setprecision( 3 ) << secTotal << " seconds, "
+	     << setprecision( 0 ) << cNodesTotal / secTotal << " nodes/second"
+	     << endl;
+
+	if (fAccuracy)
+	{
+		cout << "of " << cSolved << " moves solved, " << cBest
+		     << " as good as the best, " << cOutcome
+		     << " with the same outcome" << endl;
+	}
+
+	if (fAllocs)
+	{
+		cout << g_cAllocs << " allocations while searching" << endl;
+		if (g_cAllocs)
+		{
+			return EXIT_FAILURE;
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,303 @@
+/*
+ * dropfour-book.cpp: makes the opening book of Drop Four
+ *
+ * This file is part of Connect 4 Parallel, which is based on "Drop Four".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ */
+
+/*
+ * Usage: drop4book plyMin plyMax [difficulty [file]]
+ *
+ * Finds every position that can come up in a game with from plyMin to plyMax
+ * pieces on the board, and writes the best move in each to the book file
+ * (drop4.book if not given), for the text version to open.  With difficulty
+ * 10, the default, the positions are solved; with 9, the best move is
+ * whatever the computer would play at that difficulty.  Lower difficulties
+ * don't always play their best move, so can't make a book.
+ *
+ * The positions are shared out among the threads of the search pool, as
+ * are the moves of each position as it is solved or searched, so the book
+ * is made on every processor.  Solving is only quick from about twelve pieces
+ * on; books of earlier positions take hours or days.
+ */
+
+#include <iostream>
+using namespace std;
+#include <stdlib.h>
+#include <time.h>
+#include "board/board.h"
+#include "board/book.h"
+#include "board/solver.h"
+#include "board/searchpool.h"
+
+// The positions seen so far, as an open-addressing hash table of their
+// canonical keys plus one, so that the empty board (key 0) isn't taken for
+// an empty slot.  The keys to put in the book are listed apart, in the
+// order they were found.
+struct PositionSet
+{
+	unsigned long long* rgSlots;
+	long cSlots;               // a power of two
+	long cUsed;
+	unsigned long long* rgKeys;
+	long cKeys;
+	long cKeysMax;
+};
+
+// what the tasks making the book share
+struct BookJob
+{
+	unsigned long long* rgKeys;
+	unsigned long long* rgRecords;
+	int difficulty;
+	long cDone;
+};
+
+// a task, making the record of one position
+struct BookTask
+{
+	BookJob* pJob;
+	long iKeys;
+};
+
+static void* allocOrDie( void* pv, size_t cb )
+{
+	pv = realloc( pv, cb );
+	if (!pv)
+	{
+		cerr << "drop4book: out of memory" << endl;
+		exit( EXIT_FAILURE );
+	}
+	return pv;
+}
+
+static inline long hashKey( unsigned long long key, long cSlots )
+{
+	return (long)((key * 0x9e3779b97f4a7c15ULL) >> 32) & (cSlots - 1);
+}
+
+// Adds key to the set, unless it is there already. Returns 1 if it was added.
+static int addKey( PositionSet &set, unsigned long long key )
+{
+	unsigned long long* rgOld;
+	long cOld, iSlots, iOld;
+
+	// keep the table no more than half full
+	if (2 * (set.cUsed + 1) > set.cSlots)
+	{
+		rgOld = set.rgSlots;
+		cOld = set.cSlots;
+		set.cSlots = cOld ? 2 * cOld : 1024;
+		set.rgSlots = (unsigned long long*)calloc( set.cSlots,
+		                                           sizeof( unsigned long long ) );
+		if (!set.rgSlots)
+		{
+			cerr << "drop4book: out of memory" << endl;
+			exit( EXIT_FAILURE );
+		}
+
+		for (iOld = 0; iOld < cOld; iOld++)
+		{
+			if (rgOld[ iOld ])
+			{
+				iSlots = hashKey( rgOld[ iOld ] - 1, set.cSlots );
+				while (set.rgSlots[ iSlots ])
+				{
+					iSlots = (iSlots + 1) & (set.cSlots - 1);
+				}
+				set.rgSlots[ iSlots ] = rgOld[ iOld ];
+			}
+		}
+		free( rgOld );
+	}
+
+	iSlots = hashKey( key, set.cSlots );
+	while (set.rgSlots[ iSlots ])
+	{
+		if (set.rgSlots[ iSlots ] == key + 1)
+		{
+			return 0;
+		}
+		iSlots = (iSlots + 1) & (set.cSlots - 1);
+	}
+
+	set.rgSlots[ iSlots ] = key + 1;
+	set.cUsed++;
+	return 1;
+}
+
+// Adds to set the position, and every position reached from it with no more
+// than plyMax pieces in all, in which nobody has won yet; those with at least
+// plyMin pieces are listed for the book.  A position, or its mirror image,
+// that has been seen already is skipped with all that follows it, since
+// that has been seen too, so each is visited once however it is reached.
+static void findPositions( Position &position, int plyMin, int plyMax,
+                           PositionSet &set )
+{
+	int cMoves = position.getMoves();
+	unsigned long long key;
+	int col;
+	int fMirrored;
+
+	key = position.getCanonicalKey( fMirrored );
+	if (!addKey( set, key ))
+	{
+		return;
+	}
+
+	if (cMoves >= plyMin)
+	{
+		if (set.cKeys == set.cKeysMax)
+		{
+			set.cKeysMax = set.cKeysMax ? 2 * set.cKeysMax : 1024;
+			set.rgKeys = (unsigned long long*)allocOrDie( set.rgKeys,
+			             set.cKeysMax * sizeof( unsigned long long ) );
+		}
+		set.rgKeys[ set.cKeys++ ] = key;
+	}
+
+	if (cMoves == plyMax || cMoves == Board::mconst_posLim)
+	{
+		return;
+	}
+
+	for (col = 0; col < MAGIC_POSITION_WIDTH; col++)
+	{
+		if (position.canPlay( col ))
+		{
+			position.play( col );
+			if (!position.isWon())
+			{
+				findPositions( position, plyMin, plyMax, set );
+			}
+			position.undo( col );
+		}
+	}
+}
+
+// the body of each task
+static void makeRecord( void* pvTask )
+{
+	BookTask* pTask = (BookTask*)pvTask;
+	BookJob* pJob = pTask->pJob;
+	unsigned long long key = pJob->rgKeys[ pTask->iKeys ];
+	Position position( key );
+	BookEntry entry;
+	int rgScores[ MAGIC_POSITION_WIDTH ];
+	long cDone;
+
+	if (pJob->difficulty == Board::mconst_difficultyPerfect)
+	{
+		entry.colMove = Solver::solveMoves( position, rgScores );
+		entry.score = rgScores[ entry.colMove ];
+		entry.fExact = 1;
+	}
+	else
+	{
+		// the computer is to move, in a game that reached the position
+		Board board( key | Board::mconst_keyComputerTurn );
+
+		board.setDifficulty( pJob->difficulty );
+		entry.colMove = board.takeComputerTurn();
+		entry.score = 0;
+		entry.fExact = 0;
+	}
+
+	pJob->rgRecords[ pTask->iKeys ] = Book::makeRecord( position, entry );
+
+	cDone = __atomic_add_fetch( &pJob->cDone, 1, __ATOMIC_RELAXED );
+	if (!(cDone % 1000))
+	{
+		cerr << cDone << " positions done" << endl;
+	}
+}
+
+int main( int argc, char** argv )
+{
+	PositionSet set = { NULL, 0, 0, NULL, 0, 0 };
+	long iKeys;
+	unsigned long long* rgRecords;
+	BookTask* rgTasks;
+	BookJob job;
+	SearchGroup group;
+	Position position;
+	const char* szPath;
+	int plyMin, plyMax, difficulty;
+	time_t timeStart;
+
+	if (argc < 3 || argc > 5)
+	{
+		cerr << "usage: drop4book plyMin plyMax [difficulty [file]]" << endl;
+		return EXIT_FAILURE;
+	}
+
+	plyMin = atoi( argv[ 1 ] );
+	plyMax = atoi( argv[ 2 ] );
+	difficulty = (argc > 3) ? atoi( argv[ 3 ] ) : Board::mconst_difficultyPerfect;
+	szPath = (argc > 4) ? argv[ 4 ] : MAGIC_DEFAULT_BOOK_PATH;
+
+	if (plyMin < 0 || plyMax < plyMin || plyMax >= Board::mconst_posLim
+	    || difficulty < Board::mconst_difficultyPerfect - 1
+	    || difficulty > Board::mconst_difficultyPerfect)
+	{
+		cerr << "drop4book: bad plies, or difficulty not 9 or 10" << endl;
+		return EXIT_FAILURE;
+	}
+
+	timeStart = time( NULL );
+
+	findPositions( position, plyMin, plyMax, set );
+	free( set.rgSlots );
+
+	cerr << set.cKeys << " positions from " << plyMin << " to " << plyMax
+	     << " pieces" << endl;
+
+	rgRecords = (unsigned long long*)malloc( set.cKeys * sizeof( unsigned long long ) );
+	rgTasks = (BookTask*)malloc( set.cKeys * sizeof( BookTask ) );
+	if (!rgRecords || !rgTasks)
+	{
+		cerr << "drop4book: out of memory" << endl;
+		return EXIT_FAILURE;
+	}
+
+	job.rgKeys = set.rgKeys;
+	job.rgRecords = rgRecords;
+	job.difficulty = difficulty;
+	job.cDone = 0;
+
+	for (iKeys = 0; iKeys < set.cKeys; iKeys++)
+	{
+		rgTasks[ iKeys ].pJob = &job;
+		rgTasks[ iKeys ].iKeys = iKeys;
+		SearchPool::submit( group, makeRecord, &rgTasks[ iKeys ] );
+	}
+	SearchPool::wait( group );
+
+	if (!Book::write( szPath, rgRecords, set.cKeys ))
+	{
+		cerr << "drop4book: can't write " << szPath << endl;
+		return EXIT_FAILURE;
+	}
+
+	cerr << "wrote " << szPath << " in " << time( NULL ) - timeStart
+	     << " seconds" << endl;
+
+	free( rgTasks );
+	free( rgRecords );
+	free( set.rgKeys );
+
+	return EXIT_SUCCESS;
+}
@@ -50,6 +50,7 @@ using namespace std;
 #include <stdlib.h>
 #include "ioface.h"
 #include "board/board.h"
+#include "board/book.h"
 
 int main()
 {
@@ -59,6 +60,9 @@ int main()
 
 	init();
 
+	// the book is optional, so carry on without one if it isn't there
+	Book::open( MAGIC_DEFAULT_BOOK_PATH );
+
 	if ( askfirst() )
 	{
 		board.setHumanFirst();
@@ -64,20 +64,24 @@ int askfirst( void )
 }
 
 // modify this to change how difficulty is asked
-// should return a number from 0 to 9 (9 being most difficult)
+// should return a number from 0 to 10 (10 being perfect play)
 int askdifficulty( void )
 {
 	char input;
 	int difficulty = -1;  // by default, allows looping
 
 	do {
-		cout << "\nPlease enter level of difficulty (0-9): ";
+		cout << "\nPlease enter level of difficulty (0-9, or p to play perfectly): ";
 		input = prompt();
 
 		if (input >= '0' && input <= '9')
 		{
 			difficulty = (int)input - (int)'0';
 		}
+		if (input == 'P' || input == 'p')
+		{
+			difficulty = 10;
+		}
 	} while (difficulty == -1);
 
 	return difficulty;
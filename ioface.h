@@ -30,7 +30,7 @@ void init( void );
 // should return a 0 if computer is first and a 1 if human is first
 int askfirst( void );
 
-// should return a number from 0 to 9 (9 being most difficult)
+// should return a number from 0 to 10 (10 being perfect play)
 int askdifficulty( void );
 
 // should return a number from 0 to 6 (for the columns, left to right)